@@ -29,10 +29,12 @@ void add_result(struct results *, u64 res);
 bool results_done(struct results *, unsigned int *runs, bool rough,
 		  unsigned int forced_runs);
 bool results_range_done(struct results *, bool rough);
+bool results_samples_done(struct results *, bool rough);
 /* Answers are attached to the "struct results", so needn't be freed */
 char *results_to_csv(struct results *);
 char *results_to_dist_summary(struct results *);
 char *results_to_quick_summary(struct results *);
+char *results_to_percentiles(struct results *);
 
 /* Linker magic defines these */
 extern struct benchmark __start_benchmarks[], __stop_benchmarks[];
@@ -46,8 +48,16 @@ struct results *do_pair_bench_onestop(struct benchmark *bench, bool rough,
 				      unsigned int forced_runs);
 struct results *do_receive_bench(struct benchmark *bench, bool rough,
 				 unsigned int forced_runs);
+struct results *do_send_bench(struct benchmark *bench, bool rough,
+			      unsigned int forced_runs);
+struct results *do_duplex_bench(struct benchmark *bench, bool rough,
+				unsigned int forced_runs);
 struct results *do_clock_accuracy_bench(struct benchmark *bench, bool rough,
 					unsigned int forced_runs);
+struct results *do_sample_bench(struct benchmark *bench, bool rough,
+				unsigned int forced_runs);
+struct results *do_pair_sample_bench(struct benchmark *bench, bool rough,
+				     unsigned int forced_runs);
 
 #define NET_BANDWIDTH_SIZE 4 MB
 #define NET_WARMUP_BYTES (128 * 1024)
@@ -56,8 +66,15 @@ struct results *do_clock_accuracy_bench(struct benchmark *bench, bool rough,
 struct sockaddr;
 bool wait_for_start(int sock);
 void send_ack(int sock);
+/* For do_(pair_)sample_bench: send the per-iteration times (in nsec),
+ * usually runs of them. */
+void send_samples(int sock, const u64 *samples, u32 num);
+/* Attach a note to the results (send before the ack). */
+void send_note(int sock, const char *note);
 void exec_test(char *runstr);
+unsigned long bench_size(const struct benchmark *bench, unsigned long def);
 extern char *blockdev;
+u64 blockdev_size(int fd);
 
 #define _benchmark_ __attribute__((section("benchmarks"), used))
 
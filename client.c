@@ -12,7 +12,9 @@
 #include <stdlib.h>
 #include <time.h>
 #include <sys/stat.h>
+#include <sys/mount.h>
 #include <fcntl.h>
+#include <errno.h>
 #include "benchmarks.h"
 #include "stdrusty.h"
 
@@ -34,9 +36,16 @@ static struct benchmark *find_bench(const char *name)
 
 bool wait_for_start(int sock)
 {
+	static const char start[6];
 	struct message msg;
 
-	return read(sock, &msg, sizeof(msg)) == 6;
+	/* Only consume the start itself: the server may send data (eg.
+	 * do_send_bench) straight after it. */
+	if (recv(sock, &msg, sizeof(msg), MSG_PEEK) >= (int)sizeof(start)
+	    && memcmp(&msg, start, sizeof(start)) == 0)
+		return read(sock, &msg, sizeof(start)) == sizeof(start);
+
+	return read(sock, &msg, sizeof(msg)) == sizeof(start);
 }
 
 void send_ack(int sock)
@@ -46,6 +55,60 @@ void send_ack(int sock)
 		err(1, "writing acknowledgement");
 }
 
+void send_samples(int sock, const u64 *samples, u32 num)
+{
+	if (!write_all(sock, &num, sizeof(num))
+	    || !write_all(sock, samples, num * sizeof(samples[0])))
+		err(1, "writing samples");
+}
+
+void send_note(int sock, const char *note)
+{
+	u32 len = strlen(note);
+
+	/* A zero length would look like the ack. */
+	if (len == 0)
+		return;
+	if (!write_all(sock, &len, sizeof(len)) || !write_all(sock, note, len))
+		err(1, "writing note");
+}
+
+/* Size of the scratch block device (or file, in local mode). */
+u64 blockdev_size(int fd)
+{
+	struct stat st;
+	u64 size;
+
+	if (fstat(fd, &st) != 0)
+		err(1, "getting status of %s", blockdev);
+	if (S_ISREG(st.st_mode))
+		return st.st_size;
+	if (ioctl(fd, BLKGETSIZE64, &size) != 0)
+		err(1, "getting size of %s", blockdev);
+	return size;
+}
+
+/* For benchmarks named "foo-64k" and the like: the size, or def if none. */
+unsigned long bench_size(const struct benchmark *bench, unsigned long def)
+{
+	const char *p = strrchr(bench->name, '-');
+	unsigned long size;
+	char *end;
+
+	if (!p)
+		return def;
+	size = strtoul(p + 1, &end, 10);
+	if (end == p + 1)
+		return def;
+	if (streq(end, "k"))
+		return size * 1024;
+	if (streq(end, "m"))
+		return size * 1024 * 1024;
+	if (streq(end, ""))
+		return size;
+	return def;
+}
+
 /* Boot parameters can't have . in them, so we accept / too. */
 static u32 dotted_to_addr(const char *ipaddr)
 {
@@ -138,6 +201,17 @@ static void __attribute__((noreturn)) usage(void)
 	errx(1, "Usage: virtclient clientid serverip serverport blockdev [major minor [extifname ifaddr [intifname]]]\n");
 }
 
+/* As init, nobody else will mount /sys for us. */
+static void mount_sysfs(void)
+{
+	if (access("/sys/kernel", F_OK) == 0)
+		return;
+	if (mkdir("/sys", 0755) != 0 && errno != EEXIST)
+		warn("creating /sys");
+	else if (mount("sysfs", "/sys", "sysfs", 0, NULL) != 0)
+		warn("mounting sysfs");
+}
+
 char *argv0;
 char *blockdev;
 int main(int argc, char *argv[])
@@ -161,6 +235,7 @@ int main(int argc, char *argv[])
 			err(1, "mknod %s %u:%u\n",
 			    blockdev, atoi(argv[5]), atoi(argv[6]));
 	}
+	mount_sysfs();
 	if (argc >= 9) {
 		addr = setup_network(argv[7], argv[8]);
 		add_default_route(argv[7]);
@@ -229,9 +304,37 @@ struct results *do_receive_bench(struct benchmark *bench, bool rough,
 	return NULL;
 }
 
+struct results *do_send_bench(struct benchmark *bench, bool rough,
+			      unsigned int forced_runs)
+{
+	assert(0);
+	return NULL;
+}
+
+struct results *do_duplex_bench(struct benchmark *bench, bool rough,
+				unsigned int forced_runs)
+{
+	assert(0);
+	return NULL;
+}
+
 struct results *do_clock_accuracy_bench(struct benchmark *bench, bool rough,
 					unsigned int forced_runs)
 {
 	assert(0);
 	return NULL;
 }
+
+struct results *do_sample_bench(struct benchmark *bench, bool rough,
+				unsigned int forced_runs)
+{
+	assert(0);
+	return NULL;
+}
+
+struct results *do_pair_sample_bench(struct benchmark *bench, bool rough,
+				     unsigned int forced_runs)
+{
+	assert(0);
+	return NULL;
+}
@@ -1,6 +1,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <err.h>
@@ -41,6 +42,38 @@ static void receive_data(int fd, void *mem, unsigned long size)
 		err(1, "reading from other end");
 }
 
+struct sender
+{
+	int sock;
+	const void *mem;
+	unsigned long size;
+	u32 runs;
+};
+
+static void *send_runs(void *arg)
+{
+	struct sender *s = arg;
+	u32 i;
+
+	/* Warmup first. */
+	send_data(s->sock, s->mem, NET_WARMUP_BYTES);
+	for (i = 0; i < s->runs; i++)
+		send_data(s->sock, s->mem, s->size);
+	return NULL;
+}
+
+static void receive_runs(int sock, void *mem, unsigned long size, u32 runs)
+{
+	u64 left = (u64)runs * size;
+
+	receive_data(sock, mem, NET_WARMUP_BYTES);
+	while (left) {
+		unsigned long len = min(left, (u64)NET_BANDWIDTH_SIZE);
+		receive_data(sock, mem, len);
+		left -= len;
+	}
+}
+
 static void do_bandwidth_bench(int fd, u32 runs,
 			       struct benchmark *bench, const void *opts)
 {
@@ -49,8 +82,14 @@ static void do_bandwidth_bench(int fd, u32 runs,
 	int sock;
 	const struct pair_opt *opt = opts;
 	char *mem = malloc(BANDWIDTH_SIZE);
-
-	if (!mem)
+	/* Size of each write: the receiver just reads it all. */
+	unsigned long size = bench_size(bench, NET_BANDWIDTH_SIZE);
+	/* Duplex: both send (from a thread) and receive at once. */
+	bool duplex = streq(bench->name, "inter-tcp-bandwidth-duplex");
+	char *recvmem = duplex ? malloc(BANDWIDTH_SIZE) : mem;
+	struct sender sender;
+
+	if (!mem || !recvmem)
 		err(1, "allocating %i bytes", BANDWIDTH_SIZE);
 
 	sock = socket(PF_INET, SOCK_STREAM, 0);
@@ -90,26 +129,60 @@ static void do_bandwidth_bench(int fd, u32 runs,
 		send_ack(fd);
 	}
 
+	sender.sock = sock;
+	sender.mem = mem;
+	sender.size = size;
+	sender.runs = runs;
+
 	if (wait_for_start(fd)) {
-		u32 i;
-		/* Warmup first. */
-		if (opt->start)
-			send_data(sock, mem, NET_WARMUP_BYTES);
+		if (duplex) {
+			pthread_t thread;
+
+			if (pthread_create(&thread, NULL, send_runs, &sender))
+				errx(1, "creating thread");
+			receive_runs(sock, recvmem, size, runs);
+			pthread_join(thread, NULL);
+		} else if (opt->start)
+			send_runs(&sender);
 		else
-			receive_data(sock, mem, NET_WARMUP_BYTES);
-
-		for (i = 0; i < runs; i++) {
-			if (opt->start)
-				send_data(sock, mem, NET_BANDWIDTH_SIZE);
-			else
-				receive_data(sock, mem, NET_BANDWIDTH_SIZE);
-		}
+			receive_runs(sock, mem, size, runs);
 		send_ack(fd);
 	}
 	close(sock);
+	if (recvmem != mem)
+		free(recvmem);
 	free(mem);
 }
 
 static struct benchmark bandwidth_benchmark _benchmark_
 = { "inter-tcp-bandwidth", pretty_name, do_pair_bench, do_bandwidth_bench };
 
+
+static struct benchmark bandwidth_1_benchmark _benchmark_
+= { "inter-tcp-bandwidth-1", "Time to send 1 byte between guests",
+    do_pair_bench, do_bandwidth_bench };
+
+static struct benchmark bandwidth_64_benchmark _benchmark_
+= { "inter-tcp-bandwidth-64", "Time to send 64 bytes between guests",
+    do_pair_bench, do_bandwidth_bench };
+
+static struct benchmark bandwidth_1k_benchmark _benchmark_
+= { "inter-tcp-bandwidth-1k", "Time to send 1 kB between guests",
+    do_pair_bench, do_bandwidth_bench };
+
+static struct benchmark bandwidth_4k_benchmark _benchmark_
+= { "inter-tcp-bandwidth-4k", "Time to send 4 kB between guests",
+    do_pair_bench, do_bandwidth_bench };
+
+static struct benchmark bandwidth_64k_benchmark _benchmark_
+= { "inter-tcp-bandwidth-64k", "Time to send 64 kB between guests",
+    do_pair_bench, do_bandwidth_bench };
+
+static struct benchmark bandwidth_1m_benchmark _benchmark_
+= { "inter-tcp-bandwidth-1m", "Time to send 1 MB between guests",
+    do_pair_bench, do_bandwidth_bench };
+
+static struct benchmark bandwidth_duplex_benchmark _benchmark_
+= { "inter-tcp-bandwidth-duplex",
+    "Time to send 4 MB each way between guests at once",
+    do_pair_bench, do_bandwidth_bench };
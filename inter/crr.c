@@ -0,0 +1,137 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <err.h>
+#include "../benchmarks.h"
+
+/* Like an HTTP request and (small) reply. */
+#define CRR_REQUEST_SIZE 64
+#define CRR_RESPONSE_SIZE 64
+
+struct crr
+{
+	/* Listening socket (start side), or address to connect to. */
+	int listen_sock;
+	struct sockaddr_in saddr;
+	u32 runs;
+	/* Connections made (or served) so far. */
+	u32 next;
+};
+
+/* We close first, so TIME_WAIT ends up here, not on the connecting side
+ * where it would eat ephemeral ports. */
+static void *accept_connections(void *arg)
+{
+	struct crr *c = arg;
+	char req[CRR_REQUEST_SIZE], resp[CRR_RESPONSE_SIZE] = { 0 };
+	int sock;
+
+	while (__atomic_load_n(&c->next, __ATOMIC_RELAXED) < c->runs) {
+		sock = accept(c->listen_sock, NULL, 0);
+		if (sock < 0)
+			break;
+		if (!read_all(sock, req, sizeof(req)))
+			err(1, "reading request");
+		if (!write_all(sock, resp, sizeof(resp)))
+			err(1, "writing response");
+		close(sock);
+		/* Last one wakes any other threads stuck in accept(). */
+		if (__atomic_add_fetch(&c->next, 1, __ATOMIC_RELAXED) == c->runs)
+			shutdown(c->listen_sock, SHUT_RDWR);
+	}
+	return NULL;
+}
+
+static void *make_connections(void *arg)
+{
+	struct crr *c = arg;
+	char req[CRR_REQUEST_SIZE] = { 0 }, resp[CRR_RESPONSE_SIZE];
+
+	while (__atomic_fetch_add(&c->next, 1, __ATOMIC_RELAXED) < c->runs) {
+		int sock = socket(PF_INET, SOCK_STREAM, 0);
+
+		if (sock < 0)
+			err(1, "creating socket");
+		if (connect(sock, (struct sockaddr *)&c->saddr,
+			    sizeof(c->saddr)))
+			err(1, "connecting socket");
+		if (!write_all(sock, req, sizeof(req)))
+			err(1, "writing request");
+		if (!read_all(sock, resp, sizeof(resp)))
+			err(1, "reading response");
+		/* Wait for their close. */
+		if (read(sock, resp, 1) != 0)
+			errx(1, "expected EOF after response");
+		close(sock);
+	}
+	return NULL;
+}
+
+static void do_crr_bench(int fd, u32 runs,
+			 struct benchmark *bench, const void *opts)
+{
+	const struct pair_opt *opt = opts;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int i, nthreads = 1;
+	struct crr c;
+
+	if (streq(bench->name, "tcp-crr-threaded"))
+		nthreads = cpus > 2 ? cpus : 2;
+
+	c.runs = runs;
+	c.next = 0;
+	c.saddr.sin_family = AF_INET;
+	c.saddr.sin_port = htons(6101);
+
+	if (opt->start) {
+		/* We accept connections from other client. */
+		int set = 1;
+
+		c.listen_sock = socket(PF_INET, SOCK_STREAM, 0);
+		if (c.listen_sock < 0)
+			err(1, "creating socket");
+		c.saddr.sin_addr.s_addr = htonl(opt->yourip);
+		if (setsockopt(c.listen_sock, SOL_SOCKET, SO_REUSEADDR,
+			       &set, sizeof(set)) != 0)
+			warn("setting SO_REUSEADDR");
+		if (bind(c.listen_sock, (struct sockaddr *)&c.saddr,
+			 sizeof(c.saddr)) != 0)
+			err(1, "binding socket");
+		if (listen(c.listen_sock, SOMAXCONN) != 0)
+			err(1, "listening on socket");
+	} else {
+		/* We connect to other client. */
+		c.listen_sock = -1;
+		c.saddr.sin_addr.s_addr = htonl(opt->otherip);
+	}
+
+	send_ack(fd);
+
+	if (wait_for_start(fd)) {
+		pthread_t threads[nthreads];
+
+		for (i = 0; i < nthreads; i++) {
+			if (pthread_create(&threads[i], NULL,
+					   opt->start ? accept_connections
+					   : make_connections, &c))
+				errx(1, "creating thread");
+		}
+		for (i = 0; i < nthreads; i++)
+			pthread_join(threads[i], NULL);
+		send_ack(fd);
+	}
+	if (c.listen_sock >= 0)
+		close(c.listen_sock);
+}
+
+struct benchmark tcp_crr_benchmark _benchmark_
+= { "tcp-crr", "Time to connect, request, respond and close between guests",
+    do_pair_bench, do_crr_bench };
+
+struct benchmark tcp_crr_threaded_benchmark _benchmark_
+= { "tcp-crr-threaded",
+    "Time to connect, request, respond and close between guests, threaded",
+    do_pair_bench, do_crr_bench };
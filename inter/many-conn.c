@@ -0,0 +1,336 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <err.h>
+#include "../benchmarks.h"
+
+#define MANY_CONN_SIZE 64
+/* Requests in flight at once, each on a different connection. */
+#define MANY_CONN_DEPTH 64
+/* Connects in progress at once, so we don't overflow the listen backlog. */
+#define MANY_CONN_CONNECTING 1000
+/* Ephemeral ports run out before 28232 connections to one port. */
+#define MANY_CONN_PER_PORT 20000
+#define MANY_CONN_PORT 6200
+
+struct many_conn
+{
+	int epfd;
+	unsigned long num, closed;
+	int *socks;
+};
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * (u64)1000000000 + ts.tv_nsec;
+}
+
+static unsigned int num_ports(unsigned long num)
+{
+	return num / MANY_CONN_PER_PORT + 1;
+}
+
+static void raise_file_limit(unsigned long num)
+{
+	struct rlimit lim;
+
+	getrlimit(RLIMIT_NOFILE, &lim);
+	if (lim.rlim_cur < num + 64) {
+		lim.rlim_cur = lim.rlim_max = max(lim.rlim_max, (rlim_t)num + 64);
+		if (setrlimit(RLIMIT_NOFILE, &lim) != 0)
+			err(1, "raising file limit to %lu", num + 64);
+	}
+}
+
+static void watch(struct many_conn *m, int sock, u32 events, u32 id)
+{
+	struct epoll_event ev = { .events = events, .data.u32 = id };
+
+	if (epoll_ctl(m->epfd, EPOLL_CTL_ADD, sock, &ev) != 0)
+		err(1, "adding socket to epoll");
+}
+
+static void close_all(struct many_conn *m)
+{
+	unsigned long i;
+
+	for (i = 0; i < m->num; i++)
+		if (m->socks[i] >= 0)
+			close(m->socks[i]);
+	close(m->epfd);
+	free(m->socks);
+}
+
+/* Non-blocking connects, a limited number at a time. */
+static void connect_all(struct many_conn *m, u32 otherip)
+{
+	struct sockaddr_in saddr;
+	struct epoll_event events[MANY_CONN_DEPTH];
+	unsigned long next = 0, done = 0;
+
+	saddr.sin_family = AF_INET;
+	saddr.sin_addr.s_addr = htonl(otherip);
+
+	while (done < m->num) {
+		int i, n;
+
+		for (; next < m->num && next - done < MANY_CONN_CONNECTING; next++) {
+			int sock = socket(PF_INET, SOCK_STREAM|SOCK_NONBLOCK, 0);
+			if (sock < 0)
+				err(1, "creating socket %lu", next);
+			saddr.sin_port = htons(MANY_CONN_PORT
+					       + next % num_ports(m->num));
+			if (connect(sock, (struct sockaddr *)&saddr,
+				    sizeof(saddr)) != 0
+			    && errno != EINPROGRESS)
+				err(1, "connecting socket %lu", next);
+			m->socks[next] = sock;
+			watch(m, sock, EPOLLOUT|EPOLLONESHOT, next);
+		}
+
+		n = epoll_wait(m->epfd, events, MANY_CONN_DEPTH, -1);
+		for (i = 0; i < n; i++) {
+			int sock = m->socks[events[i].data.u32];
+			int error;
+			socklen_t len = sizeof(error);
+
+			getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &len);
+			if (error) {
+				errno = error;
+				err(1, "connecting socket %u", events[i].data.u32);
+			}
+			/* From now on we only care about replies. */
+			fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) & ~O_NONBLOCK);
+			events[i].events = EPOLLIN;
+			epoll_ctl(m->epfd, EPOLL_CTL_MOD, sock, &events[i]);
+			done++;
+		}
+	}
+}
+
+static void closed(struct many_conn *m, u32 id)
+{
+	epoll_ctl(m->epfd, EPOLL_CTL_DEL, m->socks[id], NULL);
+	close(m->socks[id]);
+	m->socks[id] = -1;
+	m->closed++;
+}
+
+static void send_request(struct many_conn *m, u32 id, char *msg)
+{
+	if (!write_all(m->socks[id], msg, MANY_CONN_SIZE))
+		err(1, "writing request");
+}
+
+/* Send num requests, keeping MANY_CONN_DEPTH in flight, to connections
+ * spread over all of them.  Returns time taken; fills samples if set. */
+static u64 send_requests(struct many_conn *m, u32 num, u64 *samples)
+{
+	struct epoll_event events[MANY_CONN_DEPTH];
+	u64 start = now_ns();
+	char msg[MANY_CONN_SIZE] = { 0 };
+	u32 next = 0, done = 0;
+
+	while (done < num) {
+		int i, n;
+
+		/* msg carries when it was sent, since replies come back
+		 * in any order. */
+		for (; next < num && next - done < MANY_CONN_DEPTH; next++) {
+			u64 sent = now_ns();
+			memcpy(msg, &sent, sizeof(sent));
+			memcpy(msg + sizeof(sent), &next, sizeof(next));
+			/* Stepping by a prime visits connections all over. */
+			send_request(m, (next * 7919UL) % m->num, msg);
+		}
+
+		n = epoll_wait(m->epfd, events, MANY_CONN_DEPTH, -1);
+		for (i = 0; i < n; i++) {
+			u32 seq, id = events[i].data.u32;
+			int ret = read(m->socks[id], msg, sizeof(msg));
+			u64 sent;
+
+			/* They close everything once they've answered it all,
+			 * so we may see one connection's close before we've
+			 * read the last replies on others. */
+			if (ret == 0) {
+				closed(m, id);
+				continue;
+			}
+			if (ret < 0 || !read_all(m->socks[id], msg + ret,
+						 sizeof(msg) - ret))
+				err(1, "reading reply");
+			memcpy(&sent, msg, sizeof(sent));
+			memcpy(&seq, msg + sizeof(sent), sizeof(seq));
+			if (samples)
+				samples[seq] = now_ns() - sent;
+			done++;
+		}
+	}
+	return now_ns() - start;
+}
+
+/* Wait for the other end to close everything. */
+static void wait_for_closes(struct many_conn *m)
+{
+	struct epoll_event events[MANY_CONN_DEPTH];
+
+	while (m->closed < m->num) {
+		int i, n = epoll_wait(m->epfd, events, MANY_CONN_DEPTH, -1);
+
+		for (i = 0; i < n; i++) {
+			u32 id = events[i].data.u32;
+			char c;
+
+			if (read(m->socks[id], &c, 1) != 0)
+				errx(1, "expected close on socket %u", id);
+			closed(m, id);
+		}
+	}
+}
+
+static void drive_connections(int fd, struct many_conn *m, u32 runs,
+			      u32 otherip)
+{
+	u64 *samples = malloc(runs * sizeof(*samples));
+	char note[80];
+	u64 elapsed;
+
+	if (!samples)
+		err(1, "allocating %u samples", runs);
+
+	connect_all(m, otherip);
+	/* Once over every connection first, so they're all accepted. */
+	send_requests(m, m->num, NULL);
+	elapsed = send_requests(m, runs, samples);
+	/* They close first, so TIME_WAIT doesn't eat our ports. */
+	wait_for_closes(m);
+
+	send_samples(fd, samples, runs);
+	sprintf(note, "%lu connections, %llu requests/sec", m->num,
+		elapsed ? runs * 1000000000ULL / elapsed : 0);
+	send_note(fd, note);
+	free(samples);
+}
+
+/* Accept and answer everything, then close it all. */
+static void serve_connections(struct many_conn *m, int *listen_socks,
+			      u32 runs)
+{
+	struct epoll_event events[MANY_CONN_DEPTH];
+	unsigned long accepted = 0, served = 0, todo = m->num + runs;
+	char msg[MANY_CONN_SIZE];
+
+	while (served < todo) {
+		int i, n = epoll_wait(m->epfd, events, MANY_CONN_DEPTH, -1);
+
+		for (i = 0; i < n; i++) {
+			u32 id = events[i].data.u32;
+			int sock;
+
+			/* Listening sockets come after the connections. */
+			if (id >= m->num) {
+				while ((sock = accept(listen_socks[id - m->num],
+						      NULL, 0)) >= 0) {
+					if (accepted == m->num)
+						errx(1, "too many connections");
+					m->socks[accepted] = sock;
+					watch(m, sock, EPOLLIN, accepted++);
+				}
+				if (errno != EAGAIN && errno != EWOULDBLOCK)
+					err(1, "accepting connection");
+				continue;
+			}
+			if (!read_all(m->socks[id], msg, sizeof(msg)))
+				err(1, "reading request");
+			if (!write_all(m->socks[id], msg, sizeof(msg)))
+				err(1, "writing reply");
+			served++;
+		}
+	}
+}
+
+static void do_many_conn_bench(int fd, u32 runs,
+			       struct benchmark *bench, const void *opts)
+{
+	const struct pair_opt *opt = opts;
+	struct many_conn m;
+	unsigned int i, ports;
+
+	m.num = bench_size(bench, 1000);
+	m.closed = 0;
+	ports = num_ports(m.num);
+	raise_file_limit(m.num + ports);
+	m.socks = malloc(m.num * sizeof(*m.socks));
+	m.epfd = epoll_create1(0);
+	if (!m.socks || m.epfd < 0)
+		err(1, "allocating for %lu connections", m.num);
+	for (i = 0; i < m.num; i++)
+		m.socks[i] = -1;
+
+	if (opt->start) {
+		/* We connect to other client, once it's listening. */
+		send_ack(fd);
+		if (wait_for_start(fd)) {
+			drive_connections(fd, &m, runs, opt->otherip);
+			send_ack(fd);
+		}
+	} else {
+		/* We accept connections from other client. */
+		int listen_socks[ports];
+		struct sockaddr_in saddr;
+		int set = 1;
+
+		saddr.sin_family = AF_INET;
+		saddr.sin_addr.s_addr = htonl(opt->yourip);
+		for (i = 0; i < ports; i++) {
+			listen_socks[i] = socket(PF_INET,
+						 SOCK_STREAM|SOCK_NONBLOCK, 0);
+			if (listen_socks[i] < 0)
+				err(1, "creating socket");
+			saddr.sin_port = htons(MANY_CONN_PORT + i);
+			if (setsockopt(listen_socks[i], SOL_SOCKET,
+				       SO_REUSEADDR, &set, sizeof(set)) != 0)
+				warn("setting SO_REUSEADDR");
+			if (bind(listen_socks[i], (struct sockaddr *)&saddr,
+				 sizeof(saddr)) != 0)
+				err(1, "binding socket to port %u",
+				    MANY_CONN_PORT + i);
+			if (listen(listen_socks[i], SOMAXCONN) != 0)
+				err(1, "listening on socket");
+			watch(&m, listen_socks[i], EPOLLIN, m.num + i);
+		}
+
+		send_ack(fd);
+		if (wait_for_start(fd)) {
+			serve_connections(&m, listen_socks, runs);
+			send_ack(fd);
+		}
+		for (i = 0; i < ports; i++)
+			close(listen_socks[i]);
+	}
+	close_all(&m);
+}
+
+struct benchmark many_conn_1k_benchmark _benchmark_
+= { "many-conn-1k", "Time for a request over one of 1k inter-guest connections",
+    do_pair_sample_bench, do_many_conn_bench };
+
+struct benchmark many_conn_10k_benchmark _benchmark_
+= { "many-conn-10k", "Time for a request over one of 10k inter-guest connections",
+    do_pair_sample_bench, do_many_conn_bench };
+
+struct benchmark many_conn_50k_benchmark _benchmark_
+= { "many-conn-50k", "Time for a request over one of 50k inter-guest connections",
+    do_pair_sample_bench, do_many_conn_bench };
@@ -0,0 +1,209 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/prctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <err.h>
+#include "../benchmarks.h"
+
+#define OPEN_LOOP_SIZE 64
+/* We offer each rate for this long, so the tail has enough samples. */
+#define OPEN_LOOP_SECONDS 1
+
+struct open_loop_req
+{
+	u32 seq;
+	char pad[OPEN_LOOP_SIZE - sizeof(u32)];
+};
+
+struct open_loop
+{
+	int sock;
+	u32 runs;
+	/* Request i is meant to go at start + i * interval. */
+	u64 start, interval;
+	u64 *samples;
+	/* When the last reply came in. */
+	u64 end;
+};
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * (u64)1000000000 + ts.tv_nsec;
+}
+
+static void sleep_until(u64 ns)
+{
+	struct timespec ts = { ns / 1000000000, ns % 1000000000 };
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL));
+}
+
+/* openloop-10k means 10,000 requests per second. */
+static unsigned long bench_rate(const struct benchmark *bench)
+{
+	const char *p = strrchr(bench->name, '-');
+	char *end;
+	unsigned long rate = strtoul(p + 1, &end, 10);
+
+	return streq(end, "k") ? rate * 1000 : rate;
+}
+
+/* Latency counts from when we *meant* to send, so if we fall behind
+ * the queueing shows up in the results rather than being hidden. */
+static void *receive_replies(void *arg)
+{
+	struct open_loop *o = arg;
+	struct open_loop_req reply;
+	u32 i;
+
+	for (i = 0; i < o->runs; i++) {
+		if (!read_all(o->sock, &reply, sizeof(reply)))
+			err(1, "reading reply");
+		if (reply.seq >= o->runs)
+			errx(1, "bad reply seq %u", reply.seq);
+		o->samples[reply.seq] = now_ns()
+			- (o->start + reply.seq * o->interval);
+	}
+	o->end = now_ns();
+	return NULL;
+}
+
+static void send_requests(int fd, struct open_loop *o)
+{
+	struct open_loop_req req;
+	pthread_t thread;
+	char note[80];
+	long slack;
+	u32 i;
+
+	memset(&req, 0, sizeof(req));
+	o->samples = malloc(o->runs * sizeof(*o->samples));
+	if (!o->samples)
+		err(1, "allocating %u samples", o->runs);
+
+	/* Default 50us timer slack would swamp the higher rates. */
+	slack = prctl(PR_GET_TIMERSLACK);
+	prctl(PR_SET_TIMERSLACK, 1);
+
+	o->start = now_ns();
+	if (pthread_create(&thread, NULL, receive_replies, o) != 0)
+		errx(1, "creating thread");
+	for (i = 0; i < o->runs; i++) {
+		sleep_until(o->start + i * o->interval);
+		req.seq = i;
+		if (!write_all(o->sock, &req, sizeof(req)))
+			err(1, "writing request");
+	}
+	pthread_join(thread, NULL);
+	prctl(PR_SET_TIMERSLACK, slack);
+
+	send_samples(fd, o->samples, o->runs);
+	sprintf(note, "offered %llu/sec, achieved %llu/sec",
+		1000000000ULL / o->interval,
+		o->end > o->start
+		? o->runs * 1000000000ULL / (o->end - o->start) : 0);
+	send_note(fd, note);
+	free(o->samples);
+}
+
+static void do_open_loop_bench(int fd, u32 runs,
+			       struct benchmark *bench, const void *opts)
+{
+	/* We're going to send TCP packets to that addr. */
+	struct sockaddr_in saddr;
+	int sock, set = 1;
+	const struct pair_opt *opt = opts;
+	struct open_loop o;
+
+	sock = socket(PF_INET, SOCK_STREAM, 0);
+	if (sock < 0)
+		err(1, "creating socket");
+
+	if (opt->start) {
+		/* We accept connection from other client. */
+		int listen_sock = sock;
+
+		saddr.sin_family = AF_INET;
+		saddr.sin_port = htons(6100);
+		saddr.sin_addr.s_addr = htonl(opt->yourip);
+		if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &set, sizeof(set)) != 0)
+			warn("setting SO_REUSEADDR");
+		if (bind(sock, (struct sockaddr *)&saddr, sizeof(saddr)) != 0)
+			err(1, "binding socket");
+
+		if (listen(sock, 0) != 0)
+			err(1, "listening on socket");
+
+		send_ack(fd);
+
+		sock = accept(listen_sock, NULL, 0);
+		if (sock < 0)
+			err(1, "accepting peer connection on socket");
+		close(listen_sock);
+	} else {
+		/* We connect to other client. */
+		saddr.sin_family = AF_INET;
+		saddr.sin_port = htons(6100);
+		saddr.sin_addr.s_addr = htonl(opt->otherip);
+		if (connect(sock, (struct sockaddr *)&saddr, sizeof(saddr)))
+			err(1, "connecting socket");
+
+		send_ack(fd);
+	}
+
+	/* Every request is its own small segment, like an RPC. */
+	if (setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &set, sizeof(set)))
+		warn("setting TCP_NODELAY");
+
+	/* Both sides work this out the same way. */
+	o.sock = sock;
+	o.runs = max(runs, (u32)(bench_rate(bench) * OPEN_LOOP_SECONDS));
+	o.interval = 1000000000ULL / bench_rate(bench);
+
+	if (wait_for_start(fd)) {
+		if (opt->start)
+			send_requests(fd, &o);
+		else {
+			struct open_loop_req req;
+			u32 i;
+
+			for (i = 0; i < o.runs; i++) {
+				if (!read_all(sock, &req, sizeof(req)))
+					err(1, "reading request");
+				if (!write_all(sock, &req, sizeof(req)))
+					err(1, "writing reply");
+			}
+		}
+		send_ack(fd);
+	}
+	close(sock);
+}
+
+struct benchmark open_loop_10k_benchmark _benchmark_
+= { "openloop-10k", "Inter-guest request latency at 10k requests/sec",
+    do_pair_sample_bench, do_open_loop_bench };
+
+struct benchmark open_loop_20k_benchmark _benchmark_
+= { "openloop-20k", "Inter-guest request latency at 20k requests/sec",
+    do_pair_sample_bench, do_open_loop_bench };
+
+struct benchmark open_loop_50k_benchmark _benchmark_
+= { "openloop-50k", "Inter-guest request latency at 50k requests/sec",
+    do_pair_sample_bench, do_open_loop_bench };
+
+struct benchmark open_loop_100k_benchmark _benchmark_
+= { "openloop-100k", "Inter-guest request latency at 100k requests/sec",
+    do_pair_sample_bench, do_open_loop_bench };
+
+struct benchmark open_loop_200k_benchmark _benchmark_
+= { "openloop-200k", "Inter-guest request latency at 200k requests/sec",
+    do_pair_sample_bench, do_open_loop_bench };
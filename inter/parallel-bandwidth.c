@@ -0,0 +1,216 @@
+#define _GNU_SOURCE // For CPU_SET and pthread_setaffinity_np
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <err.h>
+#include "../benchmarks.h"
+
+#define BANDWIDTH_SIZE 4 MB
+static const char pretty_name[]
+= "Time to send " __stringify(BANDWIDTH_SIZE) " between guests, one stream per vCPU";
+#define MB * 1024 * 1024
+
+struct stream
+{
+	pthread_t thread;
+	int sock;
+	/* How many NET_BANDWIDTH_SIZE chunks this stream sends. */
+	u32 chunks;
+	/* Receiver: bytes and time taken, for fairness. */
+	u64 bytes, ns;
+};
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * (u64)1000000000 + ts.tv_nsec;
+}
+
+static void pin_thread(pthread_t thread, int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+
+static void *send_stream(void *arg)
+{
+	struct stream *s = arg;
+	char *mem = malloc(NET_BANDWIDTH_SIZE);
+	u32 i;
+
+	if (!mem)
+		err(1, "allocating %i bytes", NET_BANDWIDTH_SIZE);
+	memset(mem, 1, NET_BANDWIDTH_SIZE);
+
+	/* Warmup first. */
+	if (!write_all(s->sock, mem, NET_WARMUP_BYTES))
+		err(1, "writing to other end");
+	for (i = 0; i < s->chunks; i++)
+		if (!write_all(s->sock, mem, NET_BANDWIDTH_SIZE))
+			err(1, "writing to other end");
+	/* Receiver reads until EOF. */
+	shutdown(s->sock, SHUT_WR);
+	free(mem);
+	return NULL;
+}
+
+static void *receive_stream(void *arg)
+{
+	struct stream *s = arg;
+	char *mem = malloc(NET_BANDWIDTH_SIZE);
+	u64 start;
+	long ret;
+
+	if (!mem)
+		err(1, "allocating %i bytes", NET_BANDWIDTH_SIZE);
+
+	if (!read_all(s->sock, mem, NET_WARMUP_BYTES))
+		err(1, "reading from other end");
+	start = now_ns();
+	s->bytes = 0;
+	while ((ret = read(s->sock, mem, NET_BANDWIDTH_SIZE)) > 0)
+		s->bytes += ret;
+	if (ret < 0)
+		err(1, "reading from other end");
+	s->ns = now_ns() - start;
+	free(mem);
+	return NULL;
+}
+
+/* Jain's index: 1 if every stream got the same throughput, 1/n if one
+ * stream got it all. */
+static double jain_fairness(const struct stream *streams, unsigned int n)
+{
+	double sum = 0, sumsq = 0;
+	unsigned int i, used = 0;
+
+	for (i = 0; i < n; i++) {
+		double x;
+
+		/* With fewer runs than streams, some sit idle. */
+		if (!streams[i].chunks)
+			continue;
+		x = streams[i].ns ? (double)streams[i].bytes / streams[i].ns : 0;
+		sum += x;
+		sumsq += x * x;
+		used++;
+	}
+	return sumsq ? sum * sum / (used * sumsq) : 1;
+}
+
+static void do_parallel_bandwidth_bench(int fd, u32 runs,
+					struct benchmark *bench,
+					const void *opts)
+{
+	/* We're going to send TCP packets to that addr. */
+	struct sockaddr_in saddr;
+	const struct pair_opt *opt = opts;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	u32 i, nstreams;
+	struct stream *streams;
+
+	if (opt->start) {
+		/* We accept connections from other client. */
+		int listen_sock, sock;
+		int set = 1;
+
+		listen_sock = socket(PF_INET, SOCK_STREAM, 0);
+		if (listen_sock < 0)
+			err(1, "creating socket");
+
+		saddr.sin_family = AF_INET;
+		saddr.sin_port = htons(6100);
+		saddr.sin_addr.s_addr = htonl(opt->yourip);
+		if (setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &set, sizeof(set)) != 0)
+			warn("setting SO_REUSEADDR");
+		if (bind(listen_sock, (struct sockaddr *)&saddr, sizeof(saddr)) != 0)
+			err(1, "binding socket");
+
+		if (listen(listen_sock, SOMAXCONN) != 0)
+			err(1, "listening on socket");
+
+		send_ack(fd);
+
+		/* The receiver decides how many streams, and tells us first. */
+		sock = accept(listen_sock, NULL, 0);
+		if (sock < 0)
+			err(1, "accepting peer connection on socket");
+		if (!read_all(sock, &nstreams, sizeof(nstreams)))
+			err(1, "reading number of streams");
+		streams = calloc(nstreams, sizeof(*streams));
+		if (!nstreams || !streams)
+			err(1, "allocating %u streams", nstreams);
+		streams[0].sock = sock;
+		for (i = 1; i < nstreams; i++) {
+			streams[i].sock = accept(listen_sock, NULL, 0);
+			if (streams[i].sock < 0)
+				err(1, "accepting peer connection on socket");
+		}
+		close(listen_sock);
+	} else {
+		/* We connect to other client, once per vCPU. */
+		nstreams = cpus;
+		streams = calloc(nstreams, sizeof(*streams));
+		if (!streams)
+			err(1, "allocating %u streams", nstreams);
+
+		saddr.sin_family = AF_INET;
+		saddr.sin_port = htons(6100);
+		saddr.sin_addr.s_addr = htonl(opt->otherip);
+		for (i = 0; i < nstreams; i++) {
+			streams[i].sock = socket(PF_INET, SOCK_STREAM, 0);
+			if (streams[i].sock < 0)
+				err(1, "creating socket");
+			if (connect(streams[i].sock, (struct sockaddr *)&saddr,
+				    sizeof(saddr)))
+				err(1, "connecting socket");
+		}
+		if (!write_all(streams[0].sock, &nstreams, sizeof(nstreams)))
+			err(1, "writing number of streams");
+
+		send_ack(fd);
+	}
+
+	/* Spread the runs evenly over the streams. */
+	for (i = 0; i < nstreams; i++)
+		streams[i].chunks = runs / nstreams + (i < runs % nstreams);
+
+	if (wait_for_start(fd)) {
+		for (i = 0; i < nstreams; i++) {
+			if (pthread_create(&streams[i].thread, NULL,
+					   opt->start ? send_stream
+					   : receive_stream, &streams[i]))
+				errx(1, "creating thread");
+			pin_thread(streams[i].thread, i % cpus);
+		}
+		for (i = 0; i < nstreams; i++)
+			pthread_join(streams[i].thread, NULL);
+
+		if (!opt->start) {
+			char note[80];
+
+			sprintf(note, "%u streams, Jain fairness %.3f",
+				nstreams, jain_fairness(streams, nstreams));
+			send_note(fd, note);
+		}
+		send_ack(fd);
+	}
+	for (i = 0; i < nstreams; i++)
+		close(streams[i].sock);
+	free(streams);
+}
+
+static struct benchmark parallel_bandwidth_benchmark _benchmark_
+= { "inter-tcp-bandwidth-parallel", pretty_name,
+    do_pair_bench, do_parallel_bandwidth_bench };
@@ -1,7 +1,9 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
+#include <stdlib.h>
 #include <err.h>
 #include "../benchmarks.h"
 
@@ -18,6 +20,11 @@ static void do_pingpong_bench(int fd, u32 runs,
 	struct sockaddr_in saddr;
 	int sock;
 	const struct pair_opt *opt = opts;
+	unsigned long size = bench_size(bench, 1);
+	char *msg = calloc(size, 1);
+
+	if (!msg)
+		err(1, "allocating %lu bytes", size);
 
 	sock = socket(PF_INET, SOCK_STREAM, 0);
 	if (sock < 0)
@@ -56,24 +63,51 @@ static void do_pingpong_bench(int fd, u32 runs,
 		send_ack(fd);
 	}
 
+	/* Don't let Nagle hold back the tail of bigger messages. */
+	if (size > 1) {
+		int set = 1;
+		if (setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &set, sizeof(set)))
+			warn("setting TCP_NODELAY");
+	}
+
 	if (wait_for_start(fd)) {
 		u32 i;
-		char c = 1;
 		for (i = 0; i < runs; i++) {
 			if (opt->start) {
-				write(sock, &c, 1);
-				read(sock, &c, 1);
+				write_all(sock, msg, size);
+				read_all(sock, msg, size);
 			} else {
-				read(sock, &c, 1);
-				write(sock, &c, 1);
+				read_all(sock, msg, size);
+				write_all(sock, msg, size);
 			}
 		}
 		send_ack(fd);
 	}
 	close(sock);
+	free(msg);
 }
 
+/* The 1 byte case; the sized variants follow. */
 struct benchmark pingpong_benchmark _benchmark_
 = { "pingpong", "Time for inter-guest pingpong",
     do_pair_bench, do_pingpong_bench };
 
+struct benchmark pingpong_64_benchmark _benchmark_
+= { "pingpong-64", "Time for inter-guest pingpong, 64 bytes",
+    do_pair_bench, do_pingpong_bench };
+
+struct benchmark pingpong_1k_benchmark _benchmark_
+= { "pingpong-1k", "Time for inter-guest pingpong, 1 kB",
+    do_pair_bench, do_pingpong_bench };
+
+struct benchmark pingpong_4k_benchmark _benchmark_
+= { "pingpong-4k", "Time for inter-guest pingpong, 4 kB",
+    do_pair_bench, do_pingpong_bench };
+
+struct benchmark pingpong_64k_benchmark _benchmark_
+= { "pingpong-64k", "Time for inter-guest pingpong, 64 kB",
+    do_pair_bench, do_pingpong_bench };
+
+struct benchmark pingpong_1m_benchmark _benchmark_
+= { "pingpong-1m", "Time for inter-guest pingpong, 1 MB",
+    do_pair_bench, do_pingpong_bench };
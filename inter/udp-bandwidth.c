@@ -1,3 +1,4 @@
+#define _GNU_SOURCE // For sendmmsg and recvmmsg
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -6,9 +7,22 @@
 #include <stdlib.h>
 #include <err.h>
 #include <stdio.h>
+#include <time.h>
 #include "../benchmarks.h"
 
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
 #define PACKETS 1000
+/* Biggest variant: IPv4 UDP can't go past 65507 bytes. */
+#define UDP_MAX_SIZE (63 * 1024)
 
 #define HIPQUAD(ip)				\
 	((u8)(ip >> 24)),			\
@@ -16,6 +30,79 @@
 	((u8)(ip >> 8)),			\
 	((u8)(ip))
 
+/* The kernel won't take more than this many segments in one GSO send. */
+#define MAX_BATCH 64
+
+enum udp_batching { UDP_SINGLE, UDP_MMSG, UDP_GSO };
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * (u64)1000000000 + ts.tv_nsec;
+}
+
+/* Returns the number of packets sent. */
+static u32 send_batch(int udpsock, char *packet, unsigned long size,
+		      u32 batch, enum udp_batching how)
+{
+	struct mmsghdr msgs[MAX_BATCH];
+	struct iovec iov = { packet, size };
+	u32 i;
+	int ret;
+
+	if (how == UDP_GSO) {
+		/* One send, which the kernel chops into size-byte UDPs. */
+		if (send(udpsock, packet, size * batch, 0) != size * batch)
+			err(1, "bad write UDP socket");
+		return batch;
+	}
+
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < batch; i++) {
+		msgs[i].msg_hdr.msg_iov = &iov;
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	ret = sendmmsg(udpsock, msgs, batch, 0);
+	if (ret <= 0)
+		err(1, "bad sendmmsg UDP socket");
+	return ret;
+}
+
+/* Returns the number of packets received. */
+static u32 recv_batch(int udpsock, char *packet, unsigned long size,
+		      u32 batch, enum udp_batching how)
+{
+	struct mmsghdr msgs[MAX_BATCH];
+	struct iovec iov[MAX_BATCH];
+	u32 i;
+	int ret;
+
+	if (how == UDP_GSO) {
+		/* With UDP_GRO, one recv can return many coalesced UDPs. */
+		ret = recv(udpsock, packet, size * MAX_BATCH, 0);
+		if (ret <= 0 || ret % size)
+			err(1, "bad read UDP socket");
+		return ret / size;
+	}
+
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < batch; i++) {
+		iov[i].iov_base = packet + i * size;
+		iov[i].iov_len = size;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	ret = recvmmsg(udpsock, msgs, batch, MSG_WAITFORONE, NULL);
+	if (ret <= 0)
+		err(1, "bad recvmmsg UDP socket");
+	for (i = 0; i < ret; i++)
+		if (msgs[i].msg_len != size)
+			errx(1, "bad recvmmsg length %u", msgs[i].msg_len);
+	return ret;
+}
+
 static void do_udp_bandwidth_bench(int fd, u32 runs,
 				   struct benchmark *bench, const void *opts)
 {
@@ -23,6 +110,19 @@ static void do_udp_bandwidth_bench(int fd, u32 runs,
 	struct sockaddr_in saddr;
 	int sock, udpsock;
 	const struct pair_opt *opt = opts;
+	unsigned long size = bench_size(bench, 1000);
+	enum udp_batching how = UDP_SINGLE;
+	u32 batch = 1;
+
+	/* udp-bandwidth-mmsg-<batch> and udp-bandwidth-gso-<batch>. */
+	if (strstr(bench->name, "-mmsg-"))
+		how = UDP_MMSG;
+	else if (strstr(bench->name, "-gso-"))
+		how = UDP_GSO;
+	if (how != UDP_SINGLE) {
+		batch = min(size, (unsigned long)MAX_BATCH);
+		size = 1000;
+	}
 
 	sock = socket(PF_INET, SOCK_STREAM, 0);
 	if (sock < 0)
@@ -71,32 +171,65 @@ static void do_udp_bandwidth_bench(int fd, u32 runs,
 		send_ack(fd);
 	}
 
+	if (how == UDP_GSO) {
+		int set = opt->start ? 1 : size;
+		if (setsockopt(udpsock, SOL_UDP, opt->start ? UDP_GRO : UDP_SEGMENT,
+			       &set, sizeof(set)) != 0) {
+			/* Old kernel?  Fall back to plain batching. */
+			warn("setting %s", opt->start ? "UDP_GRO" : "UDP_SEGMENT");
+			if (!opt->start)
+				how = UDP_MMSG;
+		}
+	}
+
 	if (wait_for_start(fd)) {
-		char packet[1000] = { 0 };
+		char packet[UDP_MAX_SIZE] = { 0 };
 		u32 i = 0;
 		if (opt->start) {
 			char c;
-			for (i = 0; i < runs * PACKETS; i++) {
+			u64 start = now_ns(), elapsed;
+
+			for (i = 0; i < runs * PACKETS; ) {
+				if (how != UDP_SINGLE) {
+					i += recv_batch(udpsock, packet, size,
+							batch, how);
+					continue;
+				}
 				if (recv(udpsock, packet, sizeof(packet), 0)
-				    != sizeof(packet))
+				    != size)
 					err(1, "bad read UDP socket");
+				i++;
+			}
+			elapsed = now_ns() - start;
+			if (how != UDP_SINGLE && elapsed) {
+				char note[80];
+				sprintf(note, "%llu packets/sec, %llu MB/sec",
+					i * (u64)1000000000 / elapsed,
+					i * (u64)size * 1000 / elapsed);
+				send_note(fd, note);
 			}
 			send_ack(fd);
 			/* Tell other end to stop sending now. */
 			write(sock, "1", 1);
 			read(sock, &c, 1);
 		} else {
-			for (i = 0; ; i++) {
-				if (send(udpsock, packet, sizeof(packet), 0)
-				    != sizeof(packet))
+			for (i = 0; ; ) {
+				u32 sent = 1;
+
+				if (how != UDP_SINGLE)
+					sent = send_batch(udpsock, packet, size,
+							  batch, how);
+				else if (send(udpsock, packet, size, 0) != size)
 					err(1, "bad write UDP socket");
 
 				/* Occasionally check if we should stop */
-				if (i > runs * PACKETS && (i % 32) == 0) {
+				if (i > runs * PACKETS
+				    && (how != UDP_SINGLE || (i % 32) == 0)) {
 					char c;
 					if (read(sock, &c, 1) == 1)
 						break;
 				}
+				i += sent;
 			}
 			write(sock, "1", 1);
 		}
@@ -110,3 +243,47 @@ static struct benchmark bandwidth_benchmark _benchmark_
     "Time to receive " __stringify(PACKETS) " 1k UDPs between guests",
     do_pair_bench_onestop, do_udp_bandwidth_bench };
 
+static struct benchmark bandwidth_1_benchmark _benchmark_
+= { "udp-bandwidth-1",
+    "Time to receive " __stringify(PACKETS) " 1 byte UDPs between guests",
+    do_pair_bench_onestop, do_udp_bandwidth_bench };
+
+static struct benchmark bandwidth_64_benchmark _benchmark_
+= { "udp-bandwidth-64",
+    "Time to receive " __stringify(PACKETS) " 64 byte UDPs between guests",
+    do_pair_bench_onestop, do_udp_bandwidth_bench };
+
+static struct benchmark bandwidth_1k_benchmark _benchmark_
+= { "udp-bandwidth-1k",
+    "Time to receive " __stringify(PACKETS) " 1 kB UDPs between guests",
+    do_pair_bench_onestop, do_udp_bandwidth_bench };
+
+static struct benchmark bandwidth_4k_benchmark _benchmark_
+= { "udp-bandwidth-4k",
+    "Time to receive " __stringify(PACKETS) " 4 kB UDPs between guests",
+    do_pair_bench_onestop, do_udp_bandwidth_bench };
+
+static struct benchmark bandwidth_63k_benchmark _benchmark_
+= { "udp-bandwidth-63k",
+    "Time to receive " __stringify(PACKETS) " 63 kB UDPs between guests",
+    do_pair_bench_onestop, do_udp_bandwidth_bench };
+
+static struct benchmark mmsg_8_benchmark _benchmark_
+= { "udp-bandwidth-mmsg-8",
+    "Time to receive " __stringify(PACKETS) " 1k UDPs between guests, sendmmsg/recvmmsg 8 at a time",
+    do_pair_bench_onestop, do_udp_bandwidth_bench };
+
+static struct benchmark mmsg_64_benchmark _benchmark_
+= { "udp-bandwidth-mmsg-64",
+    "Time to receive " __stringify(PACKETS) " 1k UDPs between guests, sendmmsg/recvmmsg 64 at a time",
+    do_pair_bench_onestop, do_udp_bandwidth_bench };
+
+static struct benchmark gso_8_benchmark _benchmark_
+= { "udp-bandwidth-gso-8",
+    "Time to receive " __stringify(PACKETS) " 1k UDPs between guests, UDP GSO/GRO 8 at a time",
+    do_pair_bench_onestop, do_udp_bandwidth_bench };
+
+static struct benchmark gso_64_benchmark _benchmark_
+= { "udp-bandwidth-gso-64",
+    "Time to receive " __stringify(PACKETS) " 1k UDPs between guests, UDP GSO/GRO 64 at a time",
+    do_pair_bench_onestop, do_udp_bandwidth_bench };
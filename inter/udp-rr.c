@@ -0,0 +1,180 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <err.h>
+#include "../benchmarks.h"
+
+/* About the size of a DNS query. */
+#define UDP_RR_SIZE 64
+/* A request not answered by then is lost, and costs this much. */
+#define UDP_RR_TIMEOUT_MS 10
+
+struct udp_rr
+{
+	u32 seq;
+	u64 sent;
+	char pad[UDP_RR_SIZE - sizeof(u32) - sizeof(u64)];
+} __attribute__((packed));
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * (u64)1000000000 + ts.tv_nsec;
+}
+
+/* Send each request, and wait for its reply (or give up on it). */
+static void send_requests(int fd, int udpsock, u32 runs)
+{
+	u64 *samples = malloc(runs * sizeof(*samples));
+	u32 i, lost = 0, late = 0;
+	struct udp_rr req;
+	char note[80];
+
+	if (!samples)
+		err(1, "allocating %u samples", runs);
+	memset(&req, 0, sizeof(req));
+
+	for (i = 0; i < runs; i++) {
+		struct pollfd pfd = { .fd = udpsock, .events = POLLIN };
+		u64 deadline;
+
+		req.seq = i;
+		req.sent = now_ns();
+		deadline = req.sent + UDP_RR_TIMEOUT_MS * (u64)1000000;
+		if (send(udpsock, &req, sizeof(req), 0) != sizeof(req))
+			err(1, "bad write UDP socket");
+
+		for (;;) {
+			struct udp_rr reply;
+			u64 now = now_ns();
+
+			if (now >= deadline
+			    || poll(&pfd, 1, (deadline - now) / 1000000 + 1) == 0) {
+				samples[i] = UDP_RR_TIMEOUT_MS * (u64)1000000;
+				lost++;
+				break;
+			}
+			if (recv(udpsock, &reply, sizeof(reply), 0)
+			    != sizeof(reply))
+				err(1, "bad read UDP socket");
+			/* An answer to one we already gave up on. */
+			if (reply.seq != i) {
+				late++;
+				continue;
+			}
+			samples[i] = now_ns() - reply.sent;
+			break;
+		}
+	}
+
+	send_samples(fd, samples, runs);
+	if (lost) {
+		sprintf(note, "%u lost, %u of those late", lost, late);
+		send_note(fd, note);
+	}
+	free(samples);
+}
+
+/* Echo requests until the other end tells us to stop over TCP. */
+static void answer_requests(int sock, int udpsock)
+{
+	struct pollfd pfds[2] = { { .fd = udpsock, .events = POLLIN },
+				  { .fd = sock, .events = POLLIN } };
+
+	while (poll(pfds, 2, -1) > 0) {
+		struct udp_rr req;
+
+		if (pfds[1].revents)
+			break;
+		if (recv(udpsock, &req, sizeof(req), 0) != sizeof(req))
+			err(1, "bad read UDP socket");
+		if (send(udpsock, &req, sizeof(req), 0) != sizeof(req))
+			err(1, "bad write UDP socket");
+	}
+}
+
+static void do_udp_rr_bench(int fd, u32 runs,
+			    struct benchmark *bench, const void *opts)
+{
+	/* We're going to send UDP packets to that addr. */
+	struct sockaddr_in saddr;
+	int sock, udpsock;
+	const struct pair_opt *opt = opts;
+	int set = 1;
+
+	sock = socket(PF_INET, SOCK_STREAM, 0);
+	if (sock < 0)
+		err(1, "creating socket");
+	udpsock = socket(PF_INET, SOCK_DGRAM, 0);
+	if (udpsock < 0)
+		err(1, "creating UDP socket");
+
+	/* Requests go from port 6100 to 6101, so both ends can share an
+	 * address (eg. local). */
+	saddr.sin_family = AF_INET;
+	saddr.sin_port = htons(opt->start ? 6100 : 6101);
+	saddr.sin_addr.s_addr = htonl(opt->yourip);
+	if (setsockopt(udpsock, SOL_SOCKET, SO_REUSEADDR, &set, sizeof(set)) != 0)
+		warn("setting SO_REUSEADDR");
+	if (bind(udpsock, (struct sockaddr *)&saddr, sizeof(saddr)) != 0)
+		err(1, "binding UDP socket");
+	saddr.sin_port = htons(opt->start ? 6101 : 6100);
+	saddr.sin_addr.s_addr = htonl(opt->otherip);
+	if (connect(udpsock, (struct sockaddr *)&saddr, sizeof(saddr)))
+		err(1, "connecting UDP socket");
+
+	if (opt->start) {
+		/* We accept connection from other client. */
+		int listen_sock = sock;
+
+		saddr.sin_family = AF_INET;
+		saddr.sin_port = htons(6100);
+		saddr.sin_addr.s_addr = htonl(opt->yourip);
+		if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &set, sizeof(set)) != 0)
+			warn("setting SO_REUSEADDR");
+		if (bind(sock, (struct sockaddr *)&saddr, sizeof(saddr)) != 0)
+			err(1, "binding socket");
+
+		if (listen(sock, 0) != 0)
+			err(1, "listening on socket");
+
+		send_ack(fd);
+
+		sock = accept(listen_sock, NULL, 0);
+		if (sock < 0)
+			err(1, "accepting peer connection on socket");
+		close(listen_sock);
+	} else {
+		/* We connect to other client. */
+		saddr.sin_family = AF_INET;
+		saddr.sin_port = htons(6100);
+		saddr.sin_addr.s_addr = htonl(opt->otherip);
+		if (connect(sock, (struct sockaddr *)&saddr, sizeof(saddr)))
+			err(1, "connecting socket");
+
+		send_ack(fd);
+	}
+
+	if (wait_for_start(fd)) {
+		if (opt->start) {
+			send_requests(fd, udpsock, runs);
+			/* Tell other end to stop answering now. */
+			write(sock, "1", 1);
+		} else
+			answer_requests(sock, udpsock);
+		send_ack(fd);
+	}
+	close(sock);
+	close(udpsock);
+}
+
+struct benchmark udp_rr_benchmark _benchmark_
+= { "udp-rr", "Time for inter-guest UDP request/response",
+    do_pair_sample_bench, do_udp_rr_bench };
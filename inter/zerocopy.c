@@ -0,0 +1,294 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/errqueue.h>
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+#include "../benchmarks.h"
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+#ifndef TCP_ZEROCOPY_RECEIVE
+#define TCP_ZEROCOPY_RECEIVE 35
+#endif
+
+#define BANDWIDTH_SIZE 4 MB
+#define MB * 1024 * 1024
+
+/* The start of struct tcp_zerocopy_receive, which is all we need. */
+struct zc_receive
+{
+	u64 address;
+	u32 length;
+	u32 recv_skip_hint;
+};
+
+struct zc_tx
+{
+	int sock;
+	bool zerocopy;
+	/* MSG_ZEROCOPY sends made, completed, and copied by the kernel anyway. */
+	u32 issued, completed, copied;
+};
+
+struct zc_rx
+{
+	int sock;
+	/* Where we map the socket's pages, or NULL to read() instead. */
+	char *map;
+	char *buf;
+	u64 mapped, copied;
+};
+
+/* Read completions off the error queue until at least "until" are done. */
+static void reap_completions(struct zc_tx *z, u32 until)
+{
+	for (;;) {
+		char control[128];
+		struct msghdr msg = { .msg_control = control,
+				      .msg_controllen = sizeof(control) };
+		struct cmsghdr *cm;
+
+		if (recvmsg(z->sock, &msg, MSG_ERRQUEUE) < 0) {
+			struct pollfd pfd = { .fd = z->sock, .events = 0 };
+
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				err(1, "reading error queue");
+			if ((int)(z->completed - until) >= 0)
+				return;
+			/* Error queue readiness shows up as POLLERR. */
+			poll(&pfd, 1, -1);
+			continue;
+		}
+
+		for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+			struct sock_extended_err *serr;
+			u32 n;
+
+			serr = (struct sock_extended_err *)CMSG_DATA(cm);
+			if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+			/* Sends ee_info to ee_data inclusive are done. */
+			n = serr->ee_data - serr->ee_info + 1;
+			z->completed += n;
+			if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+				z->copied += n;
+		}
+	}
+}
+
+static void send_zerocopy(struct zc_tx *z, const char *mem, unsigned long size)
+{
+	unsigned long done = 0;
+
+	while (done < size) {
+		long ret;
+
+		if (!z->zerocopy) {
+			if (!write_all(z->sock, mem, size))
+				err(1, "writing to other end");
+			return;
+		}
+		ret = send(z->sock, mem + done, size - done, MSG_ZEROCOPY);
+		/* Too many notifications outstanding: wait for one. */
+		if (ret < 0 && errno == ENOBUFS && z->completed != z->issued) {
+			reap_completions(z, z->completed + 1);
+			continue;
+		}
+		if (ret <= 0)
+			err(1, "writing to other end");
+		z->issued++;
+		done += ret;
+	}
+}
+
+static void receive_zerocopy(struct zc_rx *z, u64 size)
+{
+	while (size) {
+		struct zc_receive zc;
+		socklen_t len = sizeof(zc);
+		unsigned long skip;
+
+		if (!z->map) {
+			long ret = read(z->sock, z->buf, min(size, (u64)BANDWIDTH_SIZE));
+			if (ret <= 0)
+				err(1, "reading from other end");
+			size -= ret;
+			continue;
+		}
+
+		/* This also unmaps whatever the last call mapped. */
+		zc.address = (unsigned long)z->map;
+		zc.length = min(size, (u64)BANDWIDTH_SIZE);
+		zc.recv_skip_hint = 0;
+		if (getsockopt(z->sock, IPPROTO_TCP, TCP_ZEROCOPY_RECEIVE,
+			       &zc, &len) != 0)
+			err(1, "TCP_ZEROCOPY_RECEIVE");
+		size -= zc.length;
+		z->mapped += zc.length;
+
+		/* Anything not in whole pages has to be read normally. */
+		skip = min(min((u64)zc.recv_skip_hint, size),
+			   (u64)BANDWIDTH_SIZE);
+		if (skip) {
+			if (!read_all(z->sock, z->buf, skip))
+				err(1, "reading from other end");
+			size -= skip;
+			z->copied += skip;
+		} else if (!zc.length) {
+			struct pollfd pfd = { .fd = z->sock, .events = POLLIN };
+			poll(&pfd, 1, -1);
+		}
+	}
+}
+
+static void do_zerocopy_bench(int fd, u32 runs,
+			      struct benchmark *bench, const void *opts)
+{
+	/* We're going to send TCP packets to that addr. */
+	struct sockaddr_in saddr;
+	int sock;
+	const struct pair_opt *opt = opts;
+	bool tx = !streq(bench->name, "tcp-zerocopy-rx");
+	bool rx = !streq(bench->name, "tcp-zerocopy-tx");
+	/* Two buffers, so we can fill one while the other is in flight. */
+	char *mem = malloc(2 * BANDWIDTH_SIZE);
+	u32 issued_at[2] = { 0, 0 };
+	struct zc_tx ztx;
+	struct zc_rx zrx;
+	char note[80];
+
+	if (!mem)
+		err(1, "allocating %i bytes", 2 * BANDWIDTH_SIZE);
+	memset(mem, 1, 2 * BANDWIDTH_SIZE);
+
+	sock = socket(PF_INET, SOCK_STREAM, 0);
+	if (sock < 0)
+		err(1, "creating socket");
+
+	if (opt->start) {
+		/* We accept connection from other client. */
+		int listen_sock = sock;
+		int set = 1;
+
+		saddr.sin_family = AF_INET;
+		saddr.sin_port = htons(6100);
+		saddr.sin_addr.s_addr = htonl(opt->yourip);
+		if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &set, sizeof(set)) != 0)
+			warn("setting SO_REUSEADDR");
+		if (bind(sock, (struct sockaddr *)&saddr, sizeof(saddr)) != 0)
+			err(1, "binding socket");
+
+		if (listen(sock, 0) != 0)
+			err(1, "listening on socket");
+
+		send_ack(fd);
+
+		sock = accept(listen_sock, NULL, 0);
+		if (sock < 0)
+			err(1, "accepting peer connection on socket");
+		close(listen_sock);
+	} else {
+		/* We connect to other client. */
+		saddr.sin_family = AF_INET;
+		saddr.sin_port = htons(6100);
+		saddr.sin_addr.s_addr = htonl(opt->otherip);
+		if (connect(sock, (struct sockaddr *)&saddr, sizeof(saddr)))
+			err(1, "connecting socket");
+
+		send_ack(fd);
+	}
+
+	memset(&ztx, 0, sizeof(ztx));
+	memset(&zrx, 0, sizeof(zrx));
+	note[0] = '\0';
+	if (opt->start) {
+		int set = 1;
+
+		ztx.sock = sock;
+		ztx.zerocopy = tx;
+		if (tx && setsockopt(sock, SOL_SOCKET, SO_ZEROCOPY,
+				     &set, sizeof(set)) != 0) {
+			strcpy(note, "no SO_ZEROCOPY");
+			ztx.zerocopy = false;
+		}
+	} else {
+		zrx.sock = sock;
+		zrx.buf = mem;
+		if (rx) {
+			zrx.map = mmap(NULL, BANDWIDTH_SIZE, PROT_READ,
+				       MAP_SHARED, sock, 0);
+			if (zrx.map == MAP_FAILED) {
+				strcpy(note, "no TCP_ZEROCOPY_RECEIVE");
+				zrx.map = NULL;
+			}
+		}
+	}
+
+	if (wait_for_start(fd)) {
+		u32 i;
+		/* Warmup first. */
+		if (opt->start) {
+			if (!write_all(sock, mem, NET_WARMUP_BYTES))
+				err(1, "writing to other end");
+		} else if (!read_all(sock, mem, NET_WARMUP_BYTES))
+			err(1, "reading from other end");
+
+		for (i = 0; i < runs; i++) {
+			if (opt->start) {
+				/* Can't touch the buffer until it's sent. */
+				if (ztx.zerocopy)
+					reap_completions(&ztx, issued_at[i % 2]);
+				send_zerocopy(&ztx, mem + (i % 2) * BANDWIDTH_SIZE,
+					      BANDWIDTH_SIZE);
+				issued_at[i % 2] = ztx.issued;
+			} else
+				receive_zerocopy(&zrx, BANDWIDTH_SIZE);
+		}
+		if (ztx.zerocopy) {
+			reap_completions(&ztx, ztx.issued);
+			sprintf(note, "%u%% of zerocopy sends copied",
+				ztx.issued ? ztx.copied * 100 / ztx.issued : 0);
+		}
+		if (zrx.map)
+			sprintf(note, "%llu%% of bytes received by mmap",
+				zrx.mapped + zrx.copied
+				? zrx.mapped * 100 / (zrx.mapped + zrx.copied) : 0);
+		if (note[0])
+			send_note(fd, note);
+		send_ack(fd);
+	}
+	if (zrx.map)
+		munmap(zrx.map, BANDWIDTH_SIZE);
+	close(sock);
+	free(mem);
+}
+
+struct benchmark zerocopy_tx_benchmark _benchmark_
+= { "tcp-zerocopy-tx",
+    "Time to send 4 MB between guests, MSG_ZEROCOPY sender",
+    do_pair_bench, do_zerocopy_bench };
+
+struct benchmark zerocopy_rx_benchmark _benchmark_
+= { "tcp-zerocopy-rx",
+    "Time to send 4 MB between guests, TCP_ZEROCOPY_RECEIVE receiver",
+    do_pair_bench, do_zerocopy_bench };
+
+struct benchmark zerocopy_benchmark _benchmark_
+= { "tcp-zerocopy",
+    "Time to send 4 MB between guests, zerocopy both ends",
+    do_pair_bench, do_zerocopy_bench };
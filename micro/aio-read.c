@@ -0,0 +1,303 @@
+#define _GNU_SOURCE // For O_DIRECT
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+#include <err.h>
+#include "../benchmarks.h"
+
+#ifdef __NR_io_uring_setup
+#include <linux/io_uring.h>
+#endif
+
+#define AIO_BLOCK_SIZE 4096
+
+struct aio_bench
+{
+	int fd;
+	unsigned int depth;
+	u32 runs;
+	/* Pre-computed random offsets, one per read. */
+	off_t *offsets;
+	/* One aligned buffer per slot in the queue. */
+	char *bufs;
+	u64 *latency;
+	/* For the thread engine: next read to issue. */
+	u32 next;
+};
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * (u64)1000000000 + ts.tv_nsec;
+}
+
+#ifdef __NR_io_uring_setup
+struct uring
+{
+	int fd;
+	unsigned *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	/* Per slot: the iovec we read into, and when we submitted it. */
+	struct iovec *iov;
+	u64 *submitted;
+};
+
+static bool uring_setup(struct uring *u, unsigned int depth)
+{
+	struct io_uring_params p;
+	void *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	u->fd = syscall(__NR_io_uring_setup, depth, &p);
+	if (u->fd < 0)
+		return false;
+
+	sq = mmap(NULL, p.sq_off.array + p.sq_entries * sizeof(unsigned),
+		  PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+		  u->fd, IORING_OFF_SQ_RING);
+	cq = mmap(NULL, p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe),
+		  PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+		  u->fd, IORING_OFF_CQ_RING);
+	u->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+		       PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+		       u->fd, IORING_OFF_SQES);
+	if (sq == MAP_FAILED || cq == MAP_FAILED || u->sqes == MAP_FAILED)
+		err(1, "mapping io_uring");
+
+	u->sq_tail = sq + p.sq_off.tail;
+	u->sq_mask = sq + p.sq_off.ring_mask;
+	u->sq_array = sq + p.sq_off.array;
+	u->cq_head = cq + p.cq_off.head;
+	u->cq_tail = cq + p.cq_off.tail;
+	u->cq_mask = cq + p.cq_off.ring_mask;
+	u->cqes = cq + p.cq_off.cqes;
+
+	u->iov = malloc(depth * sizeof(*u->iov));
+	u->submitted = malloc(depth * sizeof(*u->submitted));
+	if (!u->iov || !u->submitted)
+		err(1, "allocating io_uring slots");
+	return true;
+}
+
+/* Queue a read into this slot: caller must io_uring_enter it. */
+static void uring_queue(struct uring *u, struct aio_bench *ab,
+			unsigned int slot, u32 idx)
+{
+	unsigned tail = *u->sq_tail, i = tail & *u->sq_mask;
+	struct io_uring_sqe *sqe = &u->sqes[i];
+
+	u->iov[slot].iov_base = ab->bufs + slot * AIO_BLOCK_SIZE;
+	u->iov[slot].iov_len = AIO_BLOCK_SIZE;
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_READV;
+	sqe->fd = ab->fd;
+	sqe->off = ab->offsets[idx];
+	sqe->addr = (unsigned long)&u->iov[slot];
+	sqe->len = 1;
+	sqe->user_data = slot;
+	u->sq_array[i] = i;
+
+	u->submitted[slot] = now_ns();
+	__atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static void uring_run(struct uring *u, struct aio_bench *ab)
+{
+	u32 issued = 0, done = 0;
+	unsigned int to_submit = 0;
+
+	while (issued < ab->runs && issued < ab->depth) {
+		uring_queue(u, ab, issued, issued);
+		issued++;
+		to_submit++;
+	}
+
+	while (done < ab->runs) {
+		unsigned head, tail;
+
+		if (syscall(__NR_io_uring_enter, u->fd, to_submit, 1,
+			    IORING_ENTER_GETEVENTS, NULL, 0) < 0)
+			err(1, "io_uring_enter");
+		to_submit = 0;
+
+		head = *u->cq_head;
+		tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+		while (head != tail) {
+			struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+			unsigned int slot = cqe->user_data;
+
+			if (cqe->res != AIO_BLOCK_SIZE)
+				errx(1, "reading from %s gave %i",
+				     blockdev, cqe->res);
+			ab->latency[done++] = now_ns() - u->submitted[slot];
+			if (issued < ab->runs) {
+				uring_queue(u, ab, slot, issued++);
+				to_submit++;
+			}
+			head++;
+		}
+		__atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+	}
+}
+
+static void uring_cleanup(struct uring *u)
+{
+	/* The ring mappings go away when we close. */
+	close(u->fd);
+	free(u->iov);
+	free(u->submitted);
+}
+#endif /* __NR_io_uring_setup */
+
+/* Without io_uring, we keep the queue full with one thread per slot. */
+struct aio_thread
+{
+	pthread_t id;
+	struct aio_bench *ab;
+	char *buf;
+};
+
+static void *aio_thread(void *arg)
+{
+	struct aio_thread *t = arg;
+	struct aio_bench *ab = t->ab;
+	u32 idx;
+
+	while ((idx = __atomic_fetch_add(&ab->next, 1, __ATOMIC_RELAXED))
+	       < ab->runs) {
+		u64 start = now_ns();
+
+		if (pread(ab->fd, t->buf, AIO_BLOCK_SIZE, ab->offsets[idx])
+		    != AIO_BLOCK_SIZE)
+			err(1, "reading from %s", blockdev);
+		ab->latency[idx] = now_ns() - start;
+	}
+	return NULL;
+}
+
+static void threads_run(struct aio_bench *ab)
+{
+	struct aio_thread threads[ab->depth];
+	unsigned int i;
+
+	ab->next = 0;
+	for (i = 0; i < ab->depth; i++) {
+		threads[i].ab = ab;
+		threads[i].buf = ab->bufs + i * AIO_BLOCK_SIZE;
+		if (pthread_create(&threads[i].id, NULL, aio_thread,
+				   &threads[i]) != 0)
+			errx(1, "creating I/O thread");
+	}
+	for (i = 0; i < ab->depth; i++)
+		pthread_join(threads[i].id, NULL);
+}
+
+static void do_aio_read(int fd, u32 runs,
+			struct benchmark *bench, const void *opts)
+{
+	struct aio_bench ab;
+	u64 blocks, start, elapsed;
+	bool use_uring = false;
+	char note[100];
+	u32 i;
+#ifdef __NR_io_uring_setup
+	struct uring u;
+#endif
+
+	ab.depth = atoi(strstr(bench->name, "-qd") + 3);
+	ab.runs = runs;
+	ab.fd = open(blockdev, O_RDONLY|O_DIRECT);
+	if (ab.fd < 0)
+		err(1, "opening %s", blockdev);
+
+	blocks = blockdev_size(ab.fd) / AIO_BLOCK_SIZE;
+	if (!blocks)
+		errx(1, "%s is too small", blockdev);
+	ab.offsets = malloc(runs * sizeof(*ab.offsets));
+	ab.latency = malloc(runs * sizeof(*ab.latency));
+	if (!ab.offsets || !ab.latency)
+		err(1, "allocating %u reads", runs);
+	for (i = 0; i < runs; i++)
+		ab.offsets[i] = (off_t)(random() % blocks) * AIO_BLOCK_SIZE;
+
+	/* O_DIRECT wants aligned buffers. */
+	if (posix_memalign((void **)&ab.bufs, getpagesize(),
+			   ab.depth * AIO_BLOCK_SIZE) != 0)
+		errx(1, "allocating %u buffers", ab.depth);
+
+#ifdef __NR_io_uring_setup
+	use_uring = uring_setup(&u, ab.depth);
+#endif
+
+	send_ack(fd);
+	if (wait_for_start(fd)) {
+		start = now_ns();
+#ifdef __NR_io_uring_setup
+		if (use_uring)
+			uring_run(&u, &ab);
+		else
+#endif
+			threads_run(&ab);
+		elapsed = now_ns() - start;
+
+		sprintf(note, "%s, %llu IOPS", use_uring ? "io_uring" : "threads",
+			elapsed ? runs * (u64)1000000000 / elapsed : 0);
+		send_samples(fd, ab.latency, runs);
+		send_note(fd, note);
+		send_ack(fd);
+	}
+
+#ifdef __NR_io_uring_setup
+	if (use_uring)
+		uring_cleanup(&u);
+#endif
+	close(ab.fd);
+	free(ab.bufs);
+	free(ab.offsets);
+	free(ab.latency);
+}
+
+struct benchmark aio_read_qd1_benchmark _benchmark_
+= { "aio-read-qd1", "Completion latency for random 4k reads at QD 1",
+    do_sample_bench, do_aio_read };
+
+struct benchmark aio_read_qd2_benchmark _benchmark_
+= { "aio-read-qd2", "Completion latency for random 4k reads at QD 2",
+    do_sample_bench, do_aio_read };
+
+struct benchmark aio_read_qd4_benchmark _benchmark_
+= { "aio-read-qd4", "Completion latency for random 4k reads at QD 4",
+    do_sample_bench, do_aio_read };
+
+struct benchmark aio_read_qd8_benchmark _benchmark_
+= { "aio-read-qd8", "Completion latency for random 4k reads at QD 8",
+    do_sample_bench, do_aio_read };
+
+struct benchmark aio_read_qd16_benchmark _benchmark_
+= { "aio-read-qd16", "Completion latency for random 4k reads at QD 16",
+    do_sample_bench, do_aio_read };
+
+struct benchmark aio_read_qd32_benchmark _benchmark_
+= { "aio-read-qd32", "Completion latency for random 4k reads at QD 32",
+    do_sample_bench, do_aio_read };
+
+struct benchmark aio_read_qd64_benchmark _benchmark_
+= { "aio-read-qd64", "Completion latency for random 4k reads at QD 64",
+    do_sample_bench, do_aio_read };
+
+struct benchmark aio_read_qd128_benchmark _benchmark_
+= { "aio-read-qd128", "Completion latency for random 4k reads at QD 128",
+    do_sample_bench, do_aio_read };
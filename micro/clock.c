@@ -0,0 +1,174 @@
+#include <sys/time.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <err.h>
+#include "../benchmarks.h"
+
+#define CLOCKSOURCE_FILE \
+	"/sys/devices/system/clocksource/clocksource0/current_clocksource"
+
+/* The guest clocksource decides whether we get vDSO or a real syscall. */
+static void send_clocksource(int fd)
+{
+	unsigned long size;
+	char *source, note[64];
+
+	source = grab_file(CLOCKSOURCE_FILE, &size);
+	if (!source) {
+		send_note(fd, "clocksource unknown");
+		return;
+	}
+	source[strcspn(source, "\n")] = '\0';
+	snprintf(note, sizeof(note), "clocksource %s", source);
+	release_file(source, size);
+	send_note(fd, note);
+}
+
+static clockid_t bench_clock(const struct benchmark *bench)
+{
+	if (streq(bench->name, "clock-realtime"))
+		return CLOCK_REALTIME;
+	if (streq(bench->name, "clock-monotonic-raw"))
+		return CLOCK_MONOTONIC_RAW;
+	if (streq(bench->name, "clock-boottime"))
+		return CLOCK_BOOTTIME;
+	return CLOCK_MONOTONIC;
+}
+
+static void do_clock_gettime(int fd, u32 runs,
+			     struct benchmark *bench, const void *opts)
+{
+	clockid_t clock = bench_clock(bench);
+
+	send_clocksource(fd);
+	send_ack(fd);
+
+	if (wait_for_start(fd)) {
+		u32 i;
+		u32 dummy = 1;
+		struct timespec ts;
+
+		for (i = 0; i < runs; i++) {
+			clock_gettime(clock, &ts);
+			dummy += ts.tv_nsec;
+		}
+		/* Avoids GCC optimizing it away, but it won't be true. */
+		if (dummy)
+			send_ack(fd);
+	}
+}
+
+static void do_gettimeofday(int fd, u32 runs,
+			    struct benchmark *bench, const void *opts)
+{
+	send_clocksource(fd);
+	send_ack(fd);
+
+	if (wait_for_start(fd)) {
+		u32 i;
+		u32 dummy = 1;
+		struct timeval tv;
+
+		for (i = 0; i < runs; i++) {
+			gettimeofday(&tv, NULL);
+			dummy += tv.tv_usec;
+		}
+		if (dummy)
+			send_ack(fd);
+	}
+}
+
+struct benchmark clock_monotonic_benchmark _benchmark_
+= { "clock-monotonic", "Time for one clock_gettime(CLOCK_MONOTONIC)",
+    do_single_bench, do_clock_gettime };
+
+struct benchmark clock_realtime_benchmark _benchmark_
+= { "clock-realtime", "Time for one clock_gettime(CLOCK_REALTIME)",
+    do_single_bench, do_clock_gettime };
+
+struct benchmark clock_monotonic_raw_benchmark _benchmark_
+= { "clock-monotonic-raw", "Time for one clock_gettime(CLOCK_MONOTONIC_RAW)",
+    do_single_bench, do_clock_gettime };
+
+struct benchmark clock_boottime_benchmark _benchmark_
+= { "clock-boottime", "Time for one clock_gettime(CLOCK_BOOTTIME)",
+    do_single_bench, do_clock_gettime };
+
+struct benchmark gettimeofday_benchmark _benchmark_
+= { "gettimeofday", "Time for one gettimeofday",
+    do_single_bench, do_gettimeofday };
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+
+static inline u64 rdtsc(void)
+{
+	u32 lo, hi;
+	asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((u64)hi << 32) | lo;
+}
+
+static void do_rdtsc(int fd, u32 runs,
+		     struct benchmark *bench, const void *opts)
+{
+	send_clocksource(fd);
+	send_ack(fd);
+
+	if (wait_for_start(fd)) {
+		u32 i;
+		u32 dummy = 1;
+
+		for (i = 0; i < runs; i++)
+			dummy += rdtsc();
+		if (dummy)
+			send_ack(fd);
+	}
+}
+
+static inline u64 rdtscp(void)
+{
+	u32 lo, hi, aux;
+	asm volatile("rdtscp" : "=a"(lo), "=d"(hi), "=c"(aux));
+	return ((u64)hi << 32) | lo;
+}
+
+/* The guest's CPU model needn't match the host's. */
+static bool have_rdtscp(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	return __get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx)
+		&& (edx & (1 << 27));
+}
+
+static void do_rdtscp(int fd, u32 runs,
+		      struct benchmark *bench, const void *opts)
+{
+	bool skip = !have_rdtscp();
+
+	if (skip)
+		send_note(fd, "skipped: CPU has no RDTSCP");
+	else
+		send_clocksource(fd);
+	send_ack(fd);
+
+	if (wait_for_start(fd)) {
+		u32 i;
+		u32 dummy = 1;
+
+		for (i = 0; i < runs && !skip; i++)
+			dummy += rdtscp();
+		if (dummy)
+			send_ack(fd);
+	}
+}
+
+struct benchmark rdtsc_benchmark _benchmark_
+= { "rdtsc", "Time for one RDTSC instruction",
+    do_single_bench, do_rdtsc };
+
+struct benchmark rdtscp_benchmark _benchmark_
+= { "rdtscp", "Time for one RDTSCP instruction",
+    do_single_bench, do_rdtscp };
+#endif /* __i386__ || __x86_64__ */
@@ -6,13 +6,125 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <err.h>
+#include <stdio.h>
 #include "../benchmarks.h"
 
+#ifdef __x86_64__
+#include <cpuid.h>
+
+/* Non-zero, so the registers aren't in their init state. */
+static const u64 fpu_pattern[8] __attribute__((aligned(64)))
+= { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+static void dirty_sse(void)
+{
+	asm volatile(".irp r,0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15\n"
+		     "movaps (%0), %%xmm\\r\n"
+		     ".endr"
+		     : : "r"(fpu_pattern)
+		     : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5",
+		       "xmm6", "xmm7", "xmm8", "xmm9", "xmm10", "xmm11",
+		       "xmm12", "xmm13", "xmm14", "xmm15");
+}
+
+static void __attribute__((target("avx2"))) dirty_avx2(void)
+{
+	asm volatile(".irp r,0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15\n"
+		     "vmovdqa (%0), %%ymm\\r\n"
+		     ".endr"
+		     : : "r"(fpu_pattern)
+		     : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5",
+		       "xmm6", "xmm7", "xmm8", "xmm9", "xmm10", "xmm11",
+		       "xmm12", "xmm13", "xmm14", "xmm15");
+}
+
+static void __attribute__((target("avx512f"))) dirty_avx512(void)
+{
+	asm volatile(".irp r,0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15\n"
+		     "vmovdqa64 (%0), %%zmm\\r\n"
+		     ".endr\n"
+		     ".irp r,16,17,18,19,20,21,22,23,24,25,26,27,28,29,30,31\n"
+		     "vmovdqa64 (%0), %%zmm\\r\n"
+		     ".endr"
+		     : : "r"(fpu_pattern)
+		     : "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5",
+		       "xmm6", "xmm7", "xmm8", "xmm9", "xmm10", "xmm11",
+		       "xmm12", "xmm13", "xmm14", "xmm15", "xmm16", "xmm17",
+		       "xmm18", "xmm19", "xmm20", "xmm21", "xmm22", "xmm23",
+		       "xmm24", "xmm25", "xmm26", "xmm27", "xmm28", "xmm29",
+		       "xmm30", "xmm31");
+}
+
+/* Size of an XSAVE state component (0 means the whole enabled area). */
+static unsigned int xsave_size(unsigned int component)
+{
+	unsigned int eax = 0, ebx = 0, ecx, edx;
+
+	__get_cpuid_count(0xD, component, &eax, &ebx, &ecx, &edx);
+	return component ? eax : ebx;
+}
+
+/* Picks what to dirty, and tells the server what the kernel must save.
+ * Returns why we can't, if this guest's CPU lacks the state. */
+static const char *fpu_dirtier(struct benchmark *b, int fd,
+			       void (**dirty)(void))
+{
+	const char *state = "SSE";
+	/* The legacy area holds x87 and SSE state. */
+	unsigned int bytes = 512;
+	char note[80];
+
+	*dirty = NULL;
+	if (streq(b->name, "context-switch"))
+		return NULL;
+
+	*dirty = dirty_sse;
+	if (!streq(b->name, "context-switch-sse")) {
+		if (!__builtin_cpu_supports("avx2"))
+			return "skipped: CPU has no AVX2";
+		*dirty = dirty_avx2;
+		state = "AVX2";
+		bytes += xsave_size(2);
+	}
+	if (streq(b->name, "context-switch-avx512")) {
+		if (!__builtin_cpu_supports("avx512f"))
+			return "skipped: CPU has no AVX-512";
+		*dirty = dirty_avx512;
+		state = "AVX-512";
+		/* Opmask, upper halves of zmm0-15, and zmm16-31. */
+		bytes += xsave_size(5) + xsave_size(6) + xsave_size(7);
+	}
+
+	sprintf(note, "%s: %u of %u XSAVE bytes dirty",
+		state, bytes, xsave_size(0));
+	send_note(fd, note);
+	return NULL;
+}
+#else
+static const char *fpu_dirtier(struct benchmark *b, int fd,
+			       void (**dirty)(void))
+{
+	*dirty = NULL;
+	return NULL;
+}
+#endif /* __x86_64__ */
+
 static void do_context_switch(int fd, u32 runs,
 			      struct benchmark *b, const void *opts)
 {
 	char c = 1;
 	int fds1[2], fds2[2], child;
+	/* Only for the variants which make the kernel save FPU state. */
+	void (*dirty)(void);
+	const char *skip = fpu_dirtier(b, fd, &dirty);
+
+	if (skip) {
+		send_note(fd, skip);
+		send_ack(fd);
+		if (wait_for_start(fd))
+			send_ack(fd);
+		return;
+	}
 
 	if (pipe(fds1) != 0 || pipe(fds2) != 0)
 		err(1, "Creating pipe");
@@ -28,6 +140,8 @@ static void do_context_switch(int fd, u32 runs,
 
 		if (wait_for_start(fd)) {
 			while ((int)runs > 0) {
+				if (dirty)
+					dirty();
 				write(fds1[1], &c, 1);
 				read(fds2[0], &c, 1);
 				runs -= 2;
@@ -45,6 +159,8 @@ static void do_context_switch(int fd, u32 runs,
 
 		while ((int)runs > 0) {
 			read(fds1[0], &c, 1);
+			if (dirty)
+				dirty();
 			write(fds2[1], &c, 1);
 			runs -= 2;
 		}
@@ -58,3 +174,16 @@ struct benchmark context_swtch_benchmark _benchmark_
 = { "context-switch", "Time for one context switch via pipe",
     do_single_bench, do_context_switch };
 
+#ifdef __x86_64__
+struct benchmark context_swtch_sse_benchmark _benchmark_
+= { "context-switch-sse", "Time for one context switch with SSE state",
+    do_single_bench, do_context_switch };
+
+struct benchmark context_swtch_avx2_benchmark _benchmark_
+= { "context-switch-avx2", "Time for one context switch with AVX2 state",
+    do_single_bench, do_context_switch };
+
+struct benchmark context_swtch_avx512_benchmark _benchmark_
+= { "context-switch-avx512", "Time for one context switch with AVX-512 state",
+    do_single_bench, do_context_switch };
+#endif /* __x86_64__ */
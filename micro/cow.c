@@ -1,43 +1,149 @@
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <unistd.h>
+#include <stdlib.h>
 #include <err.h>
 #include "../benchmarks.h"
 
+/* However many runs, we never map more than this. */
+#define COW_SIZE (64 MB)
+#define COW_HUGE_SIZE (32 MB)
+#define HUGE_PAGE_SIZE (2 MB)
+#define MB * 1024 * 1024
+
 static void do_cow(int fd, u32 runs, struct benchmark *bench, const void *opts)
 {
-	unsigned int i;
-	int *maps[runs];
+	unsigned long size, pagesize = getpagesize();
+	char *map;
 	int pagefd;
 
 	pagefd = open(blockdev, O_RDWR);
 	if (pagefd < 0)
 		err(1, "opening %s", blockdev);
 
-	for (i = 0; i < runs; i++) {
-		maps[i] = mmap(NULL, getpagesize(), PROT_READ|PROT_WRITE,
-			       MAP_PRIVATE, pagefd, 0);
-		if (maps[i] == MAP_FAILED)
-			err(1, "mapping %s", blockdev);
-	}
+	size = min(blockdev_size(pagefd), (u64)COW_SIZE) & ~(pagesize - 1);
+	map = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE, pagefd, 0);
+	if (map == MAP_FAILED)
+		err(1, "mapping %s", blockdev);
 
 	send_ack(fd);
 
 	if (wait_for_start(fd)) {
-		unsigned int i;
+		unsigned long off = 0;
+		u32 i;
 
-		for (i = 0; i < runs; i++)
-			maps[i][0] = 1;
+		for (i = 0; i < runs; i++) {
+			/* Throw away our copies, so the next lap faults again */
+			if (off == size) {
+				madvise(map, size, MADV_DONTNEED);
+				off = 0;
+			}
+			map[off] = 1;
+			off += pagesize;
+		}
 		send_ack(fd);
 	}
 
-	for (i = 0; i < runs; i++)
-		munmap(maps[i], getpagesize());
-
+	munmap(map, size);
 	close(pagefd);
 }
 
+/* A child sharing our memory, like a snapshotting fork() does. */
+static pid_t hold_snapshot(void)
+{
+	pid_t pid = fork();
+
+	if (pid == 0) {
+		for (;;)
+			pause();
+	}
+	if (pid < 0)
+		err(1, "forking");
+	return pid;
+}
+
+static void release_snapshot(pid_t pid)
+{
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+}
+
+/* Map anonymous memory, in hugetlbfs pages if huge.  Transparent huge
+ * pages won't do: a COW fault on one just splits it and copies 4k. */
+static char *map_anon(unsigned long size, bool huge)
+{
+	int flags = MAP_PRIVATE|MAP_ANONYMOUS;
+
+	if (huge) {
+#ifdef MAP_HUGETLB
+		flags |= MAP_HUGETLB;
+#else
+		return MAP_FAILED;
+#endif
+	}
+	return mmap(NULL, size, PROT_READ|PROT_WRITE, flags, -1, 0);
+}
+
+static void do_cow_fork(int fd, u32 runs,
+			struct benchmark *bench, const void *opts)
+{
+	bool huge = streq(bench->name, "cow-huge");
+	unsigned long size, stride, off;
+	pid_t child;
+	char *mem;
+
+	size = huge ? COW_HUGE_SIZE : COW_SIZE;
+	stride = huge ? HUGE_PAGE_SIZE : getpagesize();
+	mem = map_anon(size, huge);
+	if (mem == MAP_FAILED) {
+		if (!huge)
+			err(1, "mapping %lu bytes", size);
+		send_note(fd, "skipped: no hugetlbfs pages reserved");
+		send_ack(fd);
+		if (wait_for_start(fd))
+			send_ack(fd);
+		return;
+	}
+
+	for (off = 0; off < size; off += stride)
+		mem[off] = 1;
+	child = hold_snapshot();
+
+	send_ack(fd);
+
+	if (wait_for_start(fd)) {
+		u32 i;
+
+		off = 0;
+		for (i = 0; i < runs; i++) {
+			/* Everything's ours again: take a new snapshot.  The
+			 * fork is amortized over size / stride faults. */
+			if (off == size) {
+				release_snapshot(child);
+				child = hold_snapshot();
+				off = 0;
+			}
+			mem[off] = 2;
+			off += stride;
+		}
+		send_ack(fd);
+	}
+
+	release_snapshot(child);
+	munmap(mem, size);
+}
+
 struct benchmark cow_benchmark _benchmark_
 = { "cow", "Time for one Copy-on-Write fault", do_single_bench, do_cow };
+
+struct benchmark cow_fork_benchmark _benchmark_
+= { "cow-fork", "Time for one Copy-on-Write fault after fork",
+    do_single_bench, do_cow_fork };
+
+struct benchmark cow_huge_benchmark _benchmark_
+= { "cow-huge", "Time for one 2M-page Copy-on-Write fault after fork",
+    do_single_bench, do_cow_fork };
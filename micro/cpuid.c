@@ -0,0 +1,34 @@
+#include "../benchmarks.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+/* CPUID always causes a VM exit, so this is the bare exit round trip. */
+static inline u32 cpuid(u32 leaf)
+{
+	u32 eax = leaf, ebx, ecx = 0, edx;
+
+	asm volatile("cpuid"
+		     : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+	return eax ^ ebx ^ ecx ^ edx;
+}
+
+static void do_cpuid(int fd, u32 runs,
+		     struct benchmark *bench, const void *opts)
+{
+	send_ack(fd);
+
+	if (wait_for_start(fd)) {
+		u32 i;
+		u32 dummy = 1;
+
+		for (i = 0; i < runs; i++)
+			dummy += cpuid(0);
+		/* Avoids GCC optimizing it away, but it won't be true. */
+		if (dummy)
+			send_ack(fd);
+	}
+}
+
+struct benchmark cpuid_benchmark _benchmark_
+= { "cpuid", "Time for one CPUID (leaf 0) instruction",
+    do_single_bench, do_cpuid };
+#endif /* __i386__ || __x86_64__ */
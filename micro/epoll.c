@@ -0,0 +1,198 @@
+#define _GNU_SOURCE // For CPU_SET and pthread_setaffinity_np
+#include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+#include "../benchmarks.h"
+
+struct waker
+{
+	/* We wait for efd via epfd. */
+	int efd, epfd;
+};
+
+static void waker_init(struct waker *w)
+{
+	struct epoll_event ev = { .events = EPOLLIN };
+
+	w->efd = eventfd(0, 0);
+	w->epfd = epoll_create1(0);
+	if (w->efd < 0 || w->epfd < 0)
+		err(1, "creating eventfd and epoll");
+	if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->efd, &ev) != 0)
+		err(1, "adding eventfd to epoll");
+}
+
+static void waker_cleanup(struct waker *w)
+{
+	close(w->efd);
+	close(w->epfd);
+}
+
+static void wake(struct waker *w)
+{
+	u64 val = 1;
+
+	if (write(w->efd, &val, sizeof(val)) != sizeof(val))
+		err(1, "writing eventfd");
+}
+
+static void wait_woken(struct waker *w)
+{
+	struct epoll_event ev;
+	u64 val;
+
+	while (epoll_wait(w->epfd, &ev, 1, -1) != 1);
+	if (read(w->efd, &val, sizeof(val)) != sizeof(val))
+		err(1, "reading eventfd");
+}
+
+static void pin_thread(pthread_t thread, int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+
+struct wakeup_pair
+{
+	struct waker ping, pong;
+	u32 runs;
+};
+
+static void *ponger(void *arg)
+{
+	struct wakeup_pair *p = arg;
+
+	while ((int)p->runs > 0) {
+		wait_woken(&p->ping);
+		wake(&p->pong);
+		p->runs -= 2;
+	}
+	return NULL;
+}
+
+static void do_eventfd_wakeup(int fd, u32 runs,
+			      struct benchmark *bench, const void *opts)
+{
+	struct wakeup_pair p;
+	pthread_t thread;
+	int other_cpu = 0;
+	cpu_set_t oldset;
+
+	waker_init(&p.ping);
+	waker_init(&p.pong);
+	p.runs = runs;
+
+	if (streq(bench->name, "eventfd-wakeup-cross")) {
+		if (sysconf(_SC_NPROCESSORS_ONLN) > 1)
+			other_cpu = 1;
+		else
+			send_note(fd, "only one vCPU");
+	}
+
+	if (pthread_create(&thread, NULL, ponger, &p) != 0)
+		errx(1, "creating thread");
+	/* Later benchmarks shouldn't inherit our pinning. */
+	sched_getaffinity(0, sizeof(oldset), &oldset);
+	pin_thread(pthread_self(), 0);
+	pin_thread(thread, other_cpu);
+
+	send_ack(fd);
+
+	if (wait_for_start(fd)) {
+		/* Like context-switch: each round trip is two wakeups. */
+		while ((int)runs > 0) {
+			wake(&p.ping);
+			wait_woken(&p.pong);
+			runs -= 2;
+		}
+		pthread_join(thread, NULL);
+		send_ack(fd);
+	} else {
+		pthread_cancel(thread);
+		pthread_join(thread, NULL);
+	}
+	sched_setaffinity(0, sizeof(oldset), &oldset);
+	waker_cleanup(&p.ping);
+	waker_cleanup(&p.pong);
+}
+
+static void do_epoll_wait(int fd, u32 runs,
+			  struct benchmark *bench, const void *opts)
+{
+	unsigned long i, num = bench_size(bench, 1);
+	struct epoll_event ev = { .events = EPOLLIN };
+	struct rlimit lim;
+	int epfd, *efds;
+	u64 val = 1;
+
+	/* We need a few more fds than the default limit allows. */
+	getrlimit(RLIMIT_NOFILE, &lim);
+	if (lim.rlim_cur < num + 64) {
+		lim.rlim_cur = lim.rlim_max = max(lim.rlim_max, (rlim_t)num + 64);
+		if (setrlimit(RLIMIT_NOFILE, &lim) != 0)
+			err(1, "raising file limit to %lu", num + 64);
+	}
+
+	efds = malloc(num * sizeof(*efds));
+	epfd = epoll_create1(0);
+	if (!efds || epfd < 0)
+		err(1, "creating epoll for %lu fds", num);
+	for (i = 0; i < num; i++) {
+		efds[i] = eventfd(0, 0);
+		if (efds[i] < 0)
+			err(1, "creating eventfd %lu", i);
+		ev.data.u32 = i;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, efds[i], &ev) != 0)
+			err(1, "adding eventfd %lu", i);
+	}
+	/* One ready fd, which stays ready. */
+	if (write(efds[0], &val, sizeof(val)) != sizeof(val))
+		err(1, "writing eventfd");
+
+	send_ack(fd);
+
+	if (wait_for_start(fd)) {
+		u32 i;
+
+		for (i = 0; i < runs; i++) {
+			if (epoll_wait(epfd, &ev, 1, 0) != 1)
+				err(1, "epoll_wait");
+		}
+		send_ack(fd);
+	}
+
+	for (i = 0; i < num; i++)
+		close(efds[i]);
+	close(epfd);
+	free(efds);
+}
+
+struct benchmark eventfd_wakeup_same_benchmark _benchmark_
+= { "eventfd-wakeup-same", "Time to wake epoll_wait via eventfd, same vCPU",
+    do_single_bench, do_eventfd_wakeup };
+
+struct benchmark eventfd_wakeup_cross_benchmark _benchmark_
+= { "eventfd-wakeup-cross", "Time to wake epoll_wait via eventfd, other vCPU",
+    do_single_bench, do_eventfd_wakeup };
+
+struct benchmark epoll_wait_1_benchmark _benchmark_
+= { "epoll-wait-1", "Time for one epoll_wait with 1 fd registered",
+    do_single_bench, do_epoll_wait };
+
+struct benchmark epoll_wait_100_benchmark _benchmark_
+= { "epoll-wait-100", "Time for one epoll_wait with 100 fds registered",
+    do_single_bench, do_epoll_wait };
+
+struct benchmark epoll_wait_10k_benchmark _benchmark_
+= { "epoll-wait-10k", "Time for one epoll_wait with 10k fds registered",
+    do_single_bench, do_epoll_wait };
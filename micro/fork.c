@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <stdio.h>
 #include <err.h>
 #include "../benchmarks.h"
 
@@ -27,6 +29,36 @@ static void do_fork(int fd, u32 runs,
 	}
 }
 
+#define FORK_BIG_SIZE (1024 MB)
+#define MB * 1024 * 1024
+
+/* Same again, but with lots of page tables to copy. */
+static void do_fork_big(int fd, u32 runs,
+			struct benchmark *bench, const void *opts)
+{
+	unsigned long i, size, pagesize = getpagesize();
+	char *mem, note[80];
+
+	/* Don't make the guest OOM: use at most half its memory. */
+	size = min((unsigned long)sysconf(_SC_PHYS_PAGES) / 2 * pagesize,
+		   (unsigned long)FORK_BIG_SIZE);
+	mem = mmap(NULL, size, PROT_READ|PROT_WRITE,
+		   MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+		err(1, "mapping %lu bytes", size);
+	for (i = 0; i < size; i += pagesize)
+		mem[i] = 1;
+
+	sprintf(note, "%lu MB touched", size >> 20);
+	send_note(fd, note);
+	do_fork(fd, runs, bench, opts);
+	munmap(mem, size);
+}
+
 struct benchmark fork_wait_benchmark _benchmark_
 = { "fork", "Time for one fork/exit/wait",
     do_single_bench, do_fork };
+
+struct benchmark fork_big_benchmark _benchmark_
+= { "fork-1gb", "Time for one fork/exit/wait with 1GB touched",
+    do_single_bench, do_fork_big };
@@ -8,6 +8,10 @@
 
 static const char pretty_name[] 
 = "Time to send " __stringify(NET_BANDWIDTH_SIZE) " from host";
+static const char rx_pretty_name[]
+= "Time to receive " __stringify(NET_BANDWIDTH_SIZE) " from host";
+static const char duplex_pretty_name[]
+= "Time to send " __stringify(NET_BANDWIDTH_SIZE) " each way to and from host";
 #define MB * 1024 * 1024
 
 #define HIPQUAD(ip)				\
@@ -28,6 +32,12 @@ static void send_data(int fd, const void *mem, unsigned long size)
 		err(1, "writing to other end");
 }
 
+static void receive_data(int fd, void *mem, unsigned long size)
+{
+	if (!read_all(fd, mem, size))
+		err(1, "reading from other end");
+}
+
 static void do_bandwidth_bench(int fd, u32 runs,
 			       struct benchmark *bench, const void *opts)
 {
@@ -53,3 +63,52 @@ static void do_bandwidth_bench(int fd, u32 runs,
 static struct benchmark bandwidth_benchmark _benchmark_
 = { "tcp-bandwidth", pretty_name, do_receive_bench, do_bandwidth_bench };
 
+
+static void do_rx_bandwidth_bench(int fd, u32 runs,
+				  struct benchmark *bench, const void *opts)
+{
+	char *mem = malloc(NET_BANDWIDTH_SIZE);
+
+	if (!mem)
+		err(1, "allocating %i bytes", NET_BANDWIDTH_SIZE);
+
+	send_ack(fd);
+	if (wait_for_start(fd)) {
+		u32 i;
+
+		receive_data(fd, mem, NET_WARMUP_BYTES);
+		for (i = 0; i < runs; i++)
+			receive_data(fd, mem, NET_BANDWIDTH_SIZE);
+		send_ack(fd);
+	}
+	free(mem);
+}
+
+static void do_duplex_bandwidth_bench(int fd, u32 runs,
+				      struct benchmark *bench, const void *opts)
+{
+	char *sendmem = calloc(NET_BANDWIDTH_SIZE, 1);
+	char *recvmem = malloc(NET_BANDWIDTH_SIZE);
+
+	if (!sendmem || !recvmem)
+		err(1, "allocating 2 x %i bytes", NET_BANDWIDTH_SIZE);
+
+	send_ack(fd);
+	if (wait_for_start(fd)) {
+		if (!duplex_all(fd, sendmem, recvmem,
+				NET_WARMUP_BYTES
+				+ (u64)runs * NET_BANDWIDTH_SIZE,
+				NET_BANDWIDTH_SIZE))
+			err(1, "sending and receiving");
+		send_ack(fd);
+	}
+	free(sendmem);
+	free(recvmem);
+}
+
+static struct benchmark rx_bandwidth_benchmark _benchmark_
+= { "tcp-bandwidth-rx", rx_pretty_name, do_send_bench, do_rx_bandwidth_bench };
+
+static struct benchmark duplex_bandwidth_benchmark _benchmark_
+= { "tcp-bandwidth-duplex", duplex_pretty_name,
+    do_duplex_bench, do_duplex_bandwidth_bench };
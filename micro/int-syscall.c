@@ -1,25 +1,67 @@
 #include <sys/syscall.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 #include "../benchmarks.h"
 
-#ifdef __i386__
+#if defined(__i386__) || defined(__x86_64__)
+#ifdef __x86_64__
+/* int $0x80 always goes through the 32-bit syscall table. */
+#define __NR_ia32_getppid 64
+
+static inline int int_getppid()
+{
+	int ppid;
+	asm volatile("int $0x80" : "=a"(ppid) : "a"(__NR_ia32_getppid)
+		     : "r8", "r9", "r10", "r11", "memory");
+	return ppid;
+}
+#else
 static inline int int_getppid()
 {
 	int ppid;
 	asm volatile("int $0x80" : "=a"(ppid) : "a"(__NR_getppid));
 	return ppid;
 }
+#endif
+
+/* Without IA32 emulation in the guest kernel, int $0x80 just kills us,
+ * so try it once in a child first. */
+static bool have_int_syscall(void)
+{
+#ifdef __x86_64__
+	static int works = -1;
+	pid_t pid;
+	int status;
+
+	if (works == -1) {
+		pid = fork();
+		if (pid == 0)
+			_exit(int_getppid() == getppid() ? 0 : 1);
+		works = waitpid(pid, &status, 0) != -1
+			&& WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	}
+	return works;
+#else
+	return true;
+#endif
+}
 
 static void do_syscall_bench(int fd, u32 runs,
 			     struct benchmark *bench, const void *opts)
 {
+	bool skip = !have_int_syscall();
+
+	if (skip)
+		send_note(fd, "skipped: no 32-bit syscall emulation");
 	send_ack(fd);
 
 	if (wait_for_start(fd)) {
 		u32 i;
 		u32 dummy = 1;
 
-		for (i = 0; i < runs; i++)
+		for (i = 0; i < runs && !skip; i++)
 			dummy += int_getppid();
 		/* Avoids GCC optimizing it away, but it won't be true. */
 		if (dummy)
@@ -31,4 +73,4 @@ struct benchmark int_syscall_benchmark _benchmark_
 = { "int-syscall", "Time for one int-0x80 syscall",
     do_single_bench, do_syscall_bench };
 
-#endif	/* __i386__ */
+#endif	/* __i386__ || __x86_64__ */
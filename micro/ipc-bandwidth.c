@@ -0,0 +1,152 @@
+#define _GNU_SOURCE // For splice and vmsplice
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <err.h>
+#include "../benchmarks.h"
+
+static void write_message(int wfd, const char *mem, unsigned long size,
+			  bool zerocopy)
+{
+	unsigned long done = 0;
+	long ret;
+
+	while (done < size) {
+		if (zerocopy) {
+			struct iovec iov = { (char *)mem + done, size - done };
+			ret = vmsplice(wfd, &iov, 1, 0);
+		} else
+			ret = write(wfd, mem + done, size - done);
+		if (ret <= 0)
+			err(1, "writing to reader");
+		done += ret;
+	}
+}
+
+/* The reader either copies it all out, or splices it to /dev/null. */
+static void read_all_messages(int rfd, char *mem, unsigned long size,
+			      u64 total, bool zerocopy)
+{
+	int nullfd = -1;
+	long ret;
+
+	if (zerocopy) {
+		nullfd = open("/dev/null", O_WRONLY);
+		if (nullfd < 0)
+			err(1, "opening /dev/null");
+	}
+
+	while (total) {
+		if (zerocopy)
+			ret = splice(rfd, NULL, nullfd, NULL, min(total, (u64)size),
+				     SPLICE_F_MOVE);
+		else
+			ret = read(rfd, mem, min(total, (u64)size));
+		if (ret <= 0)
+			err(1, "reading from writer");
+		total -= ret;
+	}
+}
+
+static void do_ipc_bandwidth(int fd, u32 runs,
+			     struct benchmark *bench, const void *opts)
+{
+	unsigned long size = bench_size(bench, 4096);
+	bool zerocopy = strstarts(bench->name, "vmsplice");
+	int fds[2], child, status;
+	char *mem;
+
+	mem = malloc(size);
+	if (!mem)
+		err(1, "allocating %lu bytes", size);
+	memset(mem, 1, size);
+
+	if (strstarts(bench->name, "unix")) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+			err(1, "creating socketpair");
+	} else if (pipe(fds) != 0)
+		err(1, "creating pipe");
+
+	child = fork();
+	if (child == -1)
+		err(1, "forking");
+
+	if (child == 0) {
+		close(fds[1]);
+		read_all_messages(fds[0], mem, size, (u64)runs * size,
+				  zerocopy);
+		exit(0);
+	}
+
+	close(fds[0]);
+	send_ack(fd);
+
+	if (wait_for_start(fd)) {
+		u32 i;
+
+		for (i = 0; i < runs; i++)
+			write_message(fds[1], mem, size, zerocopy);
+		waitpid(child, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			errx(1, "reader failed");
+		send_ack(fd);
+	} else {
+		kill(child, SIGTERM);
+		waitpid(child, NULL, 0);
+	}
+	close(fds[1]);
+	free(mem);
+}
+
+struct benchmark pipe_bandwidth_64_benchmark _benchmark_
+= { "pipe-bandwidth-64", "Time to send 64 bytes through a pipe",
+    do_single_bench, do_ipc_bandwidth };
+
+struct benchmark pipe_bandwidth_4k_benchmark _benchmark_
+= { "pipe-bandwidth-4k", "Time to send 4 kB through a pipe",
+    do_single_bench, do_ipc_bandwidth };
+
+struct benchmark pipe_bandwidth_64k_benchmark _benchmark_
+= { "pipe-bandwidth-64k", "Time to send 64 kB through a pipe",
+    do_single_bench, do_ipc_bandwidth };
+
+struct benchmark pipe_bandwidth_1m_benchmark _benchmark_
+= { "pipe-bandwidth-1m", "Time to send 1 MB through a pipe",
+    do_single_bench, do_ipc_bandwidth };
+
+struct benchmark unix_bandwidth_64_benchmark _benchmark_
+= { "unix-bandwidth-64", "Time to send 64 bytes through a UNIX socket",
+    do_single_bench, do_ipc_bandwidth };
+
+struct benchmark unix_bandwidth_4k_benchmark _benchmark_
+= { "unix-bandwidth-4k", "Time to send 4 kB through a UNIX socket",
+    do_single_bench, do_ipc_bandwidth };
+
+struct benchmark unix_bandwidth_64k_benchmark _benchmark_
+= { "unix-bandwidth-64k", "Time to send 64 kB through a UNIX socket",
+    do_single_bench, do_ipc_bandwidth };
+
+struct benchmark unix_bandwidth_1m_benchmark _benchmark_
+= { "unix-bandwidth-1m", "Time to send 1 MB through a UNIX socket",
+    do_single_bench, do_ipc_bandwidth };
+
+struct benchmark vmsplice_bandwidth_64_benchmark _benchmark_
+= { "vmsplice-bandwidth-64", "Time to vmsplice/splice 64 bytes via a pipe",
+    do_single_bench, do_ipc_bandwidth };
+
+struct benchmark vmsplice_bandwidth_4k_benchmark _benchmark_
+= { "vmsplice-bandwidth-4k", "Time to vmsplice/splice 4 kB via a pipe",
+    do_single_bench, do_ipc_bandwidth };
+
+struct benchmark vmsplice_bandwidth_64k_benchmark _benchmark_
+= { "vmsplice-bandwidth-64k", "Time to vmsplice/splice 64 kB via a pipe",
+    do_single_bench, do_ipc_bandwidth };
+
+struct benchmark vmsplice_bandwidth_1m_benchmark _benchmark_
+= { "vmsplice-bandwidth-1m", "Time to vmsplice/splice 1 MB via a pipe",
+    do_single_bench, do_ipc_bandwidth };
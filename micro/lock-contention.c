@@ -0,0 +1,200 @@
+#define _GNU_SOURCE // For CPU_SET and pthread_setaffinity_np
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <err.h>
+#include "../benchmarks.h"
+
+/* Work done inside, and outside, the lock on each acquisition. */
+#define CRITICAL_LOOPS 100
+#define PAUSE_LOOPS 200
+/* How long we keep them fighting, for the throughput figure. */
+#define CONTENTION_NS 1000000000ULL
+
+struct ticket_lock
+{
+	unsigned int next, owner;
+};
+
+struct contention
+{
+	struct benchmark *bench;
+	u32 runs;
+	/* Everyone starts together, and stops once stop is set. */
+	pthread_barrier_t barrier;
+	volatile bool stop;
+	/* Acquisitions so far; the first runs of them are sampled. */
+	unsigned long next;
+	u64 *latency;
+	struct ticket_lock ticket;
+	pthread_mutex_t mutex;
+	/* 0 = unlocked, 1 = locked, 2 = locked with waiters. */
+	int futex;
+	volatile unsigned long counter;
+};
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * (u64)1000000000 + ts.tv_nsec;
+}
+
+static inline void cpu_relax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	asm volatile("pause");
+#endif
+}
+
+static void ticket_lock(struct ticket_lock *t)
+{
+	unsigned int me = __atomic_fetch_add(&t->next, 1, __ATOMIC_RELAXED);
+
+	while (__atomic_load_n(&t->owner, __ATOMIC_ACQUIRE) != me)
+		cpu_relax();
+}
+
+static void ticket_unlock(struct ticket_lock *t)
+{
+	__atomic_store_n(&t->owner, t->owner + 1, __ATOMIC_RELEASE);
+}
+
+/* Drepper's "Futexes are tricky" mutex, take 2. */
+static void futex_lock(int *f)
+{
+	int c = 0;
+
+	if (__atomic_compare_exchange_n(f, &c, 1, false, __ATOMIC_ACQUIRE,
+					__ATOMIC_RELAXED))
+		return;
+	if (c != 2)
+		c = __atomic_exchange_n(f, 2, __ATOMIC_ACQUIRE);
+	while (c != 0) {
+		syscall(__NR_futex, f, FUTEX_WAIT_PRIVATE, 2, NULL, NULL, 0);
+		c = __atomic_exchange_n(f, 2, __ATOMIC_ACQUIRE);
+	}
+}
+
+static void futex_unlock(int *f)
+{
+	if (__atomic_exchange_n(f, 0, __ATOMIC_RELEASE) != 1)
+		syscall(__NR_futex, f, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+static void *contend(void *arg)
+{
+	struct contention *c = arg;
+	bool spin = streq(c->bench->name, "lock-spin");
+	bool mutex = streq(c->bench->name, "lock-mutex");
+	unsigned long idx;
+
+	pthread_barrier_wait(&c->barrier);
+	for (;;) {
+		u64 start = now_ns();
+		unsigned int i;
+
+		idx = __atomic_fetch_add(&c->next, 1, __ATOMIC_RELAXED);
+		if (idx >= c->runs && c->stop)
+			break;
+
+		if (spin)
+			ticket_lock(&c->ticket);
+		else if (mutex)
+			pthread_mutex_lock(&c->mutex);
+		else
+			futex_lock(&c->futex);
+		if (idx < c->runs)
+			c->latency[idx] = now_ns() - start;
+
+		for (i = 0; i < CRITICAL_LOOPS; i++)
+			c->counter++;
+
+		if (spin)
+			ticket_unlock(&c->ticket);
+		else if (mutex)
+			pthread_mutex_unlock(&c->mutex);
+		else
+			futex_unlock(&c->futex);
+
+		for (i = 0; i < PAUSE_LOOPS; i++)
+			cpu_relax();
+	}
+	return NULL;
+}
+
+/* One thread per vCPU, each pinned, all fighting over one lock for
+ * CONTENTION_NS (or until we have runs samples, if that's longer). */
+static void do_lock_contention(int fd, u32 runs,
+			       struct benchmark *bench, const void *opts)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int i, nthreads = cpus > 2 ? cpus : 2;
+	pthread_t threads[nthreads];
+	struct contention c;
+	u64 start, elapsed;
+	char note[80];
+
+	memset(&c, 0, sizeof(c));
+	c.bench = bench;
+	c.runs = runs;
+	c.latency = malloc(runs * sizeof(*c.latency));
+	if (!c.latency)
+		err(1, "allocating %u samples", runs);
+	pthread_mutex_init(&c.mutex, NULL);
+	pthread_barrier_init(&c.barrier, NULL, nthreads + 1);
+
+	send_ack(fd);
+	if (wait_for_start(fd)) {
+		struct timespec ts = { CONTENTION_NS / 1000000000,
+				       CONTENTION_NS % 1000000000 };
+
+		/* Thread startup shouldn't count against the lock. */
+		for (i = 0; i < nthreads; i++) {
+			cpu_set_t set;
+
+			if (pthread_create(&threads[i], NULL, contend, &c))
+				errx(1, "creating thread");
+			CPU_ZERO(&set);
+			CPU_SET(i % cpus, &set);
+			pthread_setaffinity_np(threads[i], sizeof(set), &set);
+		}
+		pthread_barrier_wait(&c.barrier);
+		start = now_ns();
+		nanosleep(&ts, NULL);
+		c.stop = true;
+		for (i = 0; i < nthreads; i++)
+			pthread_join(threads[i], NULL);
+		elapsed = now_ns() - start;
+
+		/* Each thread's final increment of next didn't lock. */
+		sprintf(note, "%u threads, %llu acquisitions/sec", nthreads,
+			elapsed ? (c.next - nthreads) * (u64)1000000000
+			/ elapsed : 0);
+		send_samples(fd, c.latency, runs);
+		send_note(fd, note);
+		send_ack(fd);
+	}
+	pthread_barrier_destroy(&c.barrier);
+	pthread_mutex_destroy(&c.mutex);
+	free(c.latency);
+}
+
+struct benchmark lock_spin_benchmark _benchmark_
+= { "lock-spin", "Time to acquire a contended ticket spinlock",
+    do_sample_bench, do_lock_contention };
+
+struct benchmark lock_mutex_benchmark _benchmark_
+= { "lock-mutex", "Time to acquire a contended pthread mutex",
+    do_sample_bench, do_lock_contention };
+
+struct benchmark lock_futex_benchmark _benchmark_
+= { "lock-futex", "Time to acquire a contended futex lock",
+    do_sample_bench, do_lock_contention };
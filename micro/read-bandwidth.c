@@ -15,38 +15,60 @@
 static const char pretty_name[] = "Time to read from disk " __stringify(READ_SIZE);
 #define kB * 1024
 
+/* We cycle through this many buffers, however many runs we do. */
+#define READ_RING 4
+
 static void do_read_bandwidth(int fd, u32 runs,
 			      struct benchmark *bench, const void *opts)
 {
+	unsigned long size = bench_size(bench, READ_SIZE), num;
 	int testfd;
-	char *p, *pa;
+	char *ring;
 
-	p = malloc(READ_SIZE*runs+getpagesize()-1);
 	/* O_DIRECT wants an aligned pointer. */
-	pa = (void *)(((unsigned long)p+getpagesize()-1) & ~(getpagesize()-1));
+	if (posix_memalign((void **)&ring, getpagesize(), size * READ_RING))
+		errx(1, "allocating %u x %lu bytes", READ_RING, size);
 
 	testfd = open(blockdev, O_RDONLY|O_DIRECT);
 	if (testfd < 0)
 		err(1, "opening %s", blockdev);
-	if (read(testfd, pa, READ_SIZE*runs) != READ_SIZE*runs)
-		errx(1, "%s too small for %u runs", blockdev, runs);
+	num = blockdev_size(testfd) / size;
+	if (!num)
+		errx(1, "%s too small for %lu bytes", blockdev, size);
 
 	send_ack(fd);
 	if (wait_for_start(fd)) {
 		u32 i;
 
+		/* Stream through the device, wrapping at the end. */
 		for (i = 0; i < runs; i++) {
 			int r;
-			lseek(testfd, 0, SEEK_SET);
-			r = read(testfd, pa, READ_SIZE*runs);
-			if (r != READ_SIZE*runs)
+			lseek(testfd, (off_t)(i % num) * size, SEEK_SET);
+			r = read(testfd, ring + (i % READ_RING) * size, size);
+			if (r != size)
 				err(1, "reading from %s gave %i", blockdev, r);
 		}
 		send_ack(fd);
 	}
 	close(testfd);
-	free(p);
+	free(ring);
 }
 
 static struct benchmark read_bandwidth_benchmark _benchmark_
 = { "read-bandwidth", pretty_name, do_single_bench, do_read_bandwidth };
+
+static struct benchmark read_bandwidth_4k_benchmark _benchmark_
+= { "read-bandwidth-4k", "Time to read from disk (4 kB)",
+    do_single_bench, do_read_bandwidth };
+
+static struct benchmark read_bandwidth_64k_benchmark _benchmark_
+= { "read-bandwidth-64k", "Time to read from disk (64 kB)",
+    do_single_bench, do_read_bandwidth };
+
+static struct benchmark read_bandwidth_1m_benchmark _benchmark_
+= { "read-bandwidth-1m", "Time to read from disk (1 MB)",
+    do_single_bench, do_read_bandwidth };
+
+static struct benchmark read_bandwidth_4m_benchmark _benchmark_
+= { "read-bandwidth-4m", "Time to read from disk (4 MB)",
+    do_single_bench, do_read_bandwidth };
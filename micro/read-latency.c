@@ -41,6 +41,60 @@ static void do_read_latency(int fd, u32 runs,
 	free(p);
 }
 
+/* Reading the same block every time just measures someone's cache. */
+static void do_read_latency_random(int fd, u32 runs,
+				   struct benchmark *bench, const void *opts)
+{
+	int testfd;
+	struct stat st;
+	char *p, *pa;
+	off_t *offsets;
+	unsigned long i, num;
+
+	testfd = open(blockdev, O_RDONLY|O_DIRECT, 0);
+	if (testfd < 0)
+		err(1, "opening %s", blockdev);
+
+	fstat(testfd, &st);
+	p = malloc(st.st_blksize*2);
+	/* O_DIRECT wants an aligned pointer. */
+	pa = (void *)(((unsigned long)p+st.st_blksize-1) & ~(st.st_blksize-1));
+
+	/* Every block on the device, in random order. */
+	num = blockdev_size(testfd) / st.st_blksize;
+	if (!num)
+		errx(1, "%s is too small", blockdev);
+	offsets = malloc(num * sizeof(*offsets));
+	if (!offsets)
+		err(1, "allocating %lu offsets", num);
+	for (i = 0; i < num; i++)
+		offsets[i] = (off_t)i * st.st_blksize;
+	/* Fisher-Yates, so every order is equally likely. */
+	for (i = num - 1; i > 0; i--) {
+		unsigned long r = random() % (i + 1);
+		off_t tmp = offsets[i];
+		offsets[i] = offsets[r];
+		offsets[r] = tmp;
+	}
+
+	send_ack(fd);
+	if (wait_for_start(fd)) {
+		for (i = 0; i < runs; i++) {
+			lseek(testfd, offsets[i % num], SEEK_SET);
+			if (read(testfd, pa, st.st_blksize) != st.st_blksize)
+				err(1, "reading from %s", blockdev);
+		}
+		send_ack(fd);
+	}
+	close(testfd);
+	free(offsets);
+	free(p);
+}
+
 struct benchmark read_latency_benchmark _benchmark_
 = { "read-latency", "Time for one disk read",
     do_single_bench, do_read_latency };
+
+struct benchmark read_latency_random_benchmark _benchmark_
+= { "read-latency-random", "Time for one disk read at a random offset",
+    do_single_bench, do_read_latency_random };
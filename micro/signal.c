@@ -0,0 +1,212 @@
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <err.h>
+#include "../benchmarks.h"
+
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
+
+/* However many runs, userfaultfd only ever registers this much. */
+#define UFFD_SIZE (16 MB)
+#define MB * 1024 * 1024
+
+static volatile sig_atomic_t signals;
+
+static void count_signal(int sig)
+{
+	signals++;
+}
+
+static void do_signal(int fd, u32 runs,
+		      struct benchmark *bench, const void *opts)
+{
+	struct sigaction act, oldact;
+
+	act.sa_handler = count_signal;
+	sigemptyset(&act.sa_mask);
+	act.sa_flags = 0;
+	sigaction(SIGUSR1, &act, &oldact);
+	signals = 0;
+
+	send_ack(fd);
+
+	if (wait_for_start(fd)) {
+		u32 i;
+
+		for (i = 0; i < runs; i++)
+			kill(getpid(), SIGUSR1);
+		if (signals == runs)
+			send_ack(fd);
+	}
+	sigaction(SIGUSR1, &oldact, NULL);
+}
+
+static char *protected_page;
+
+/* Like a GC write barrier: unprotect the page and let the write retry. */
+static void fixup_segv(int sig, siginfo_t *info, void *ctx)
+{
+	if ((char *)info->si_addr != protected_page)
+		abort();
+	mprotect(protected_page, getpagesize(), PROT_READ|PROT_WRITE);
+	signals++;
+}
+
+static void do_sigsegv(int fd, u32 runs,
+		       struct benchmark *bench, const void *opts)
+{
+	struct sigaction act, oldact;
+
+	protected_page = mmap(NULL, getpagesize(), PROT_READ|PROT_WRITE,
+			      MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (protected_page == MAP_FAILED)
+		err(1, "mapping page");
+	protected_page[0] = 0;
+
+	act.sa_sigaction = fixup_segv;
+	sigemptyset(&act.sa_mask);
+	act.sa_flags = SA_SIGINFO;
+	sigaction(SIGSEGV, &act, &oldact);
+	signals = 0;
+
+	send_ack(fd);
+
+	if (wait_for_start(fd)) {
+		u32 i;
+
+		for (i = 0; i < runs; i++) {
+			mprotect(protected_page, getpagesize(), PROT_READ);
+			((volatile char *)protected_page)[0] = i;
+		}
+		if (signals == runs)
+			send_ack(fd);
+	}
+	sigaction(SIGSEGV, &oldact, NULL);
+	munmap(protected_page, getpagesize());
+}
+
+struct uffd_handler
+{
+	int uffd;
+	char *page;
+};
+
+/* Fill each missing page as it's faulted in. */
+static void *handle_faults(void *arg)
+{
+	struct uffd_handler *h = arg;
+	struct uffd_msg msg;
+	unsigned long pagesize = getpagesize();
+
+	while (read(h->uffd, &msg, sizeof(msg)) == sizeof(msg)) {
+		struct uffdio_copy copy;
+
+		if (msg.event != UFFD_EVENT_PAGEFAULT)
+			continue;
+		copy.dst = msg.arg.pagefault.address & ~(pagesize - 1);
+		copy.src = (unsigned long)h->page;
+		copy.len = pagesize;
+		copy.mode = 0;
+		if (ioctl(h->uffd, UFFDIO_COPY, &copy) != 0)
+			err(1, "UFFDIO_COPY");
+	}
+	return NULL;
+}
+
+/* Returns -1 if the guest kernel won't give us one. */
+static int open_userfaultfd(void)
+{
+	struct uffdio_api api = { .api = UFFD_API };
+	int uffd;
+
+	/* Unprivileged users may only handle user faults. */
+	uffd = syscall(__NR_userfaultfd, O_CLOEXEC|UFFD_USER_MODE_ONLY);
+	if (uffd < 0)
+		uffd = syscall(__NR_userfaultfd, O_CLOEXEC);
+	if (uffd >= 0 && ioctl(uffd, UFFDIO_API, &api) != 0) {
+		close(uffd);
+		uffd = -1;
+	}
+	return uffd;
+}
+
+static void do_userfaultfd(int fd, u32 runs,
+			   struct benchmark *bench, const void *opts)
+{
+	struct uffdio_register reg;
+	struct uffd_handler h;
+	unsigned long pagesize = getpagesize(), off;
+	pthread_t thread;
+	char *region;
+
+	h.uffd = open_userfaultfd();
+	if (h.uffd < 0) {
+		send_note(fd, "skipped: no userfaultfd");
+		send_ack(fd);
+		if (wait_for_start(fd))
+			send_ack(fd);
+		return;
+	}
+	h.page = malloc(pagesize);
+	if (!h.page)
+		err(1, "allocating page");
+	memset(h.page, 1, pagesize);
+
+	region = mmap(NULL, UFFD_SIZE, PROT_READ|PROT_WRITE,
+		      MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (region == MAP_FAILED)
+		err(1, "mapping %u bytes", UFFD_SIZE);
+	reg.range.start = (unsigned long)region;
+	reg.range.len = UFFD_SIZE;
+	reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+	if (ioctl(h.uffd, UFFDIO_REGISTER, &reg) != 0)
+		err(1, "UFFDIO_REGISTER");
+
+	if (pthread_create(&thread, NULL, handle_faults, &h) != 0)
+		errx(1, "creating fault handling thread");
+
+	send_ack(fd);
+
+	if (wait_for_start(fd)) {
+		u32 i;
+
+		off = 0;
+		for (i = 0; i < runs; i++) {
+			/* Zap it all so the next lap faults again. */
+			if (off == UFFD_SIZE) {
+				madvise(region, UFFD_SIZE, MADV_DONTNEED);
+				off = 0;
+			}
+			((volatile char *)region)[off];
+			off += pagesize;
+		}
+		send_ack(fd);
+	}
+
+	pthread_cancel(thread);
+	pthread_join(thread, NULL);
+	munmap(region, UFFD_SIZE);
+	close(h.uffd);
+	free(h.page);
+}
+
+struct benchmark signal_benchmark _benchmark_
+= { "signal", "Time to send and handle one signal to self",
+    do_single_bench, do_signal };
+
+struct benchmark sigsegv_benchmark _benchmark_
+= { "sigsegv", "Time to protect, fault and fix up one page via SIGSEGV",
+    do_single_bench, do_sigsegv };
+
+struct benchmark userfaultfd_benchmark _benchmark_
+= { "userfaultfd", "Time to handle one missing page via userfaultfd",
+    do_single_bench, do_userfaultfd };
@@ -0,0 +1,142 @@
+#define _GNU_SOURCE // For clone
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include <sched.h>
+#include <spawn.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <err.h>
+#include "../benchmarks.h"
+
+#define CLONE_STACK_SIZE (64 * 1024)
+
+static void *thread_fn(void *arg)
+{
+	return arg;
+}
+
+static void do_pthread_create(int fd, u32 runs,
+			      struct benchmark *bench, const void *opts)
+{
+	send_ack(fd);
+
+	if (wait_for_start(fd)) {
+		unsigned int i;
+
+		for (i = 0; i < runs; i++) {
+			pthread_t thread;
+
+			if (pthread_create(&thread, NULL, thread_fn, NULL))
+				errx(1, "creating thread");
+			pthread_join(thread, NULL);
+		}
+		send_ack(fd);
+	}
+}
+
+static int clone_fn(void *arg)
+{
+	return 0;
+}
+
+static void do_clone_vm(int fd, u32 runs,
+			struct benchmark *bench, const void *opts)
+{
+	char *stack = malloc(CLONE_STACK_SIZE);
+
+	if (!stack)
+		err(1, "allocating clone stack");
+
+	send_ack(fd);
+
+	if (wait_for_start(fd)) {
+		unsigned int i;
+
+		for (i = 0; i < runs; i++) {
+			/* Stack grows down on everything we care about. */
+			if (clone(clone_fn, stack + CLONE_STACK_SIZE,
+				  CLONE_VM|SIGCHLD, NULL) == -1)
+				err(1, "cloning");
+			wait(NULL);
+		}
+		send_ack(fd);
+	}
+	free(stack);
+}
+
+static void do_vfork(int fd, u32 runs,
+		     struct benchmark *bench, const void *opts)
+{
+	send_ack(fd);
+
+	if (wait_for_start(fd)) {
+		unsigned int i;
+
+		for (i = 0; i < runs; i++) {
+			switch (vfork()) {
+			case 0:
+				_exit(0);
+			case -1:
+				err(1, "vforking");
+			default:
+				wait(NULL);
+			}
+		}
+		send_ack(fd);
+	}
+}
+
+/* The static helper lives next to us (in the initrd, or locally). */
+extern char *argv0;
+static void do_posix_spawn(int fd, u32 runs,
+			   struct benchmark *bench, const void *opts)
+{
+	char helper[strlen(argv0) + sizeof("spawnhelper")];
+	char *argv[] = { helper, NULL };
+	extern char **environ;
+	char *slash;
+
+	strcpy(helper, argv0);
+	slash = strrchr(helper, '/');
+	strcpy(slash ? slash + 1 : helper, "spawnhelper");
+
+	send_ack(fd);
+
+	if (wait_for_start(fd)) {
+		unsigned int i;
+		int ret, status;
+
+		for (i = 0; i < runs; i++) {
+			pid_t pid;
+
+			ret = posix_spawn(&pid, helper, NULL, NULL, argv,
+					  environ);
+			if (ret != 0)
+				errx(1, "spawning %s: %s", helper,
+				     strerror(ret));
+			waitpid(pid, &status, 0);
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+				errx(1, "%s failed", helper);
+		}
+		send_ack(fd);
+	}
+}
+
+struct benchmark pthread_create_benchmark _benchmark_
+= { "pthread-create", "Time for one pthread_create/join",
+    do_single_bench, do_pthread_create };
+
+struct benchmark clone_vm_benchmark _benchmark_
+= { "clone-vm", "Time for one clone(CLONE_VM)/exit/wait",
+    do_single_bench, do_clone_vm };
+
+struct benchmark vfork_benchmark _benchmark_
+= { "vfork", "Time for one vfork/_exit/wait",
+    do_single_bench, do_vfork };
+
+struct benchmark posix_spawn_benchmark _benchmark_
+= { "posix-spawn", "Time to posix_spawn a static helper once",
+    do_single_bench, do_posix_spawn };
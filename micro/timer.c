@@ -0,0 +1,128 @@
+#include <sys/types.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <err.h>
+#include "../benchmarks.h"
+
+static u64 timespec_to_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * (u64)1000000000 + ts->tv_nsec;
+}
+
+static struct timespec ns_to_timespec(u64 ns)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ns / 1000000000;
+	ts.tv_nsec = ns % 1000000000;
+	return ts;
+}
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return timespec_to_ns(&ts);
+}
+
+/* Names are "<method>-<interval>{us,ms}". */
+static u64 timer_interval(const struct benchmark *bench)
+{
+	unsigned long interval;
+	char units[3];
+
+	if (sscanf(strrchr(bench->name, '-'), "-%lu%2s", &interval, units) != 2)
+		errx(1, "bad timer benchmark name %s", bench->name);
+	if (streq(units, "ms"))
+		return interval * 1000000;
+	return interval * 1000;
+}
+
+static void sleep_until(int tfd, u64 target)
+{
+	struct timespec ts = ns_to_timespec(target);
+
+	if (tfd < 0) {
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+				       NULL) != 0);
+	} else {
+		struct itimerspec its = { .it_value = ts };
+		u64 expirations;
+
+		if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) != 0)
+			err(1, "setting timerfd");
+		if (read(tfd, &expirations, sizeof(expirations))
+		    != sizeof(expirations))
+			err(1, "reading timerfd");
+	}
+}
+
+static void do_timer_bench(int fd, u32 runs,
+			   struct benchmark *bench, const void *opts)
+{
+	u64 interval = timer_interval(bench), *lateness;
+	int tfd = -1;
+
+	lateness = malloc(runs * sizeof(*lateness));
+	if (!lateness)
+		err(1, "allocating %u samples", runs);
+
+	if (strstarts(bench->name, "timerfd")) {
+		tfd = timerfd_create(CLOCK_MONOTONIC, 0);
+		if (tfd < 0)
+			err(1, "creating timerfd");
+	}
+
+	send_ack(fd);
+	if (wait_for_start(fd)) {
+		u32 i;
+
+		for (i = 0; i < runs; i++) {
+			u64 target = now_ns() + interval;
+
+			sleep_until(tfd, target);
+			lateness[i] = now_ns() - target;
+		}
+		send_samples(fd, lateness, runs);
+		send_ack(fd);
+	}
+	if (tfd >= 0)
+		close(tfd);
+	free(lateness);
+}
+
+struct benchmark nanosleep_10us_benchmark _benchmark_
+= { "nanosleep-10us", "Wakeup lateness for 10us clock_nanosleep",
+    do_sample_bench, do_timer_bench };
+
+struct benchmark nanosleep_100us_benchmark _benchmark_
+= { "nanosleep-100us", "Wakeup lateness for 100us clock_nanosleep",
+    do_sample_bench, do_timer_bench };
+
+struct benchmark nanosleep_1ms_benchmark _benchmark_
+= { "nanosleep-1ms", "Wakeup lateness for 1ms clock_nanosleep",
+    do_sample_bench, do_timer_bench };
+
+struct benchmark nanosleep_10ms_benchmark _benchmark_
+= { "nanosleep-10ms", "Wakeup lateness for 10ms clock_nanosleep",
+    do_sample_bench, do_timer_bench };
+
+struct benchmark timerfd_10us_benchmark _benchmark_
+= { "timerfd-10us", "Wakeup lateness for 10us timerfd",
+    do_sample_bench, do_timer_bench };
+
+struct benchmark timerfd_100us_benchmark _benchmark_
+= { "timerfd-100us", "Wakeup lateness for 100us timerfd",
+    do_sample_bench, do_timer_bench };
+
+struct benchmark timerfd_1ms_benchmark _benchmark_
+= { "timerfd-1ms", "Wakeup lateness for 1ms timerfd",
+    do_sample_bench, do_timer_bench };
+
+struct benchmark timerfd_10ms_benchmark _benchmark_
+= { "timerfd-10ms", "Wakeup lateness for 10ms timerfd",
+    do_sample_bench, do_timer_bench };
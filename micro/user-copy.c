@@ -0,0 +1,106 @@
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <err.h>
+#include "../benchmarks.h"
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * (u64)1000000000 + ts.tv_nsec;
+}
+
+/* read() from /dev/zero fills our buffer; write() to /dev/null never even
+ * looks at it, so the difference is the cost of the copy itself. */
+static void do_user_copy(int fd, u32 runs,
+			 struct benchmark *bench, const void *opts)
+{
+	unsigned long size = bench_size(bench, 4096);
+	bool reading = strstarts(bench->name, "read");
+	const char *dev = reading ? "/dev/zero" : "/dev/null";
+	char *buf, note[80];
+	int devfd;
+
+	devfd = open(dev, reading ? O_RDONLY : O_WRONLY);
+	if (devfd < 0)
+		err(1, "opening %s", dev);
+	buf = malloc(size);
+	if (!buf)
+		err(1, "allocating %lu bytes", size);
+	/* Fault it in now, not during the first run. */
+	memset(buf, 1, size);
+
+	send_ack(fd);
+
+	if (wait_for_start(fd)) {
+		u64 start = now_ns(), elapsed;
+		u32 i;
+
+		for (i = 0; i < runs; i++) {
+			long ret;
+
+			if (reading)
+				ret = read(devfd, buf, size);
+			else
+				ret = write(devfd, buf, size);
+			if (ret != size)
+				err(1, "%s %s", reading ? "reading" : "writing",
+				    dev);
+		}
+		elapsed = now_ns() - start;
+
+		if (reading) {
+			sprintf(note, "%llu MB/sec", elapsed
+				? (u64)runs * size * 1000 / elapsed : 0);
+			send_note(fd, note);
+		}
+		send_ack(fd);
+	}
+	free(buf);
+	close(devfd);
+}
+
+struct benchmark read_zero_1_benchmark _benchmark_
+= { "read-zero-1", "Time to read 1 byte from /dev/zero",
+    do_single_bench, do_user_copy };
+
+struct benchmark read_zero_64_benchmark _benchmark_
+= { "read-zero-64", "Time to read 64 bytes from /dev/zero",
+    do_single_bench, do_user_copy };
+
+struct benchmark read_zero_4k_benchmark _benchmark_
+= { "read-zero-4k", "Time to read 4 kB from /dev/zero",
+    do_single_bench, do_user_copy };
+
+struct benchmark read_zero_64k_benchmark _benchmark_
+= { "read-zero-64k", "Time to read 64 kB from /dev/zero",
+    do_single_bench, do_user_copy };
+
+struct benchmark read_zero_1m_benchmark _benchmark_
+= { "read-zero-1m", "Time to read 1 MB from /dev/zero",
+    do_single_bench, do_user_copy };
+
+struct benchmark write_null_1_benchmark _benchmark_
+= { "write-null-1", "Time to write 1 byte to /dev/null",
+    do_single_bench, do_user_copy };
+
+struct benchmark write_null_64_benchmark _benchmark_
+= { "write-null-64", "Time to write 64 bytes to /dev/null",
+    do_single_bench, do_user_copy };
+
+struct benchmark write_null_4k_benchmark _benchmark_
+= { "write-null-4k", "Time to write 4 kB to /dev/null",
+    do_single_bench, do_user_copy };
+
+struct benchmark write_null_64k_benchmark _benchmark_
+= { "write-null-64k", "Time to write 64 kB to /dev/null",
+    do_single_bench, do_user_copy };
+
+struct benchmark write_null_1m_benchmark _benchmark_
+= { "write-null-1m", "Time to write 1 MB to /dev/null",
+    do_single_bench, do_user_copy };
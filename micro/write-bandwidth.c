@@ -0,0 +1,75 @@
+#define _GNU_SOURCE // For O_DIRECT
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <err.h>
+#include "../benchmarks.h"
+
+#ifndef O_DIRECT
+#define O_DIRECT	00040000	/* direct disk access hint */
+#endif
+
+#define WRITE_SIZE (256 kB)
+static const char pretty_name[]
+= "Time to write to disk " __stringify(WRITE_SIZE);
+static const char pretty_name_dsync[]
+= "Time to O_DSYNC write to disk " __stringify(WRITE_SIZE);
+static const char pretty_name_fdatasync[]
+= "Time to write and fdatasync " __stringify(WRITE_SIZE);
+#define kB * 1024
+
+static void do_write_bandwidth(int fd, u32 runs,
+			       struct benchmark *bench, const void *opts)
+{
+	int testfd, flags = O_WRONLY|O_DIRECT;
+	bool sync = strends(bench->name, "-fdatasync");
+	char *p, *pa;
+	unsigned long num;
+
+	if (strends(bench->name, "-dsync"))
+		flags |= O_DSYNC;
+
+	p = malloc(WRITE_SIZE+getpagesize()-1);
+	/* O_DIRECT wants an aligned pointer. */
+	pa = (void *)(((unsigned long)p+getpagesize()-1) & ~(getpagesize()-1));
+	memset(pa, 0x5A, WRITE_SIZE);
+
+	testfd = open(blockdev, flags);
+	if (testfd < 0)
+		err(1, "opening %s", blockdev);
+	num = blockdev_size(testfd) / WRITE_SIZE;
+	if (!num)
+		errx(1, "%s too small for " __stringify(WRITE_SIZE), blockdev);
+
+	send_ack(fd);
+	if (wait_for_start(fd)) {
+		u32 i;
+
+		/* Stream through the device, wrapping at the end. */
+		for (i = 0; i < runs; i++) {
+			int r;
+			lseek(testfd, (off_t)(i % num) * WRITE_SIZE, SEEK_SET);
+			r = write(testfd, pa, WRITE_SIZE);
+			if (r != WRITE_SIZE)
+				err(1, "writing to %s gave %i", blockdev, r);
+			if (sync && fdatasync(testfd) != 0)
+				err(1, "syncing %s", blockdev);
+		}
+		send_ack(fd);
+	}
+	close(testfd);
+	free(p);
+}
+
+static struct benchmark write_bandwidth_benchmark _benchmark_
+= { "write-bandwidth", pretty_name, do_single_bench, do_write_bandwidth };
+
+static struct benchmark write_bandwidth_dsync_benchmark _benchmark_
+= { "write-bandwidth-dsync", pretty_name_dsync,
+    do_single_bench, do_write_bandwidth };
+
+static struct benchmark write_bandwidth_fdatasync_benchmark _benchmark_
+= { "write-bandwidth-fdatasync", pretty_name_fdatasync,
+    do_single_bench, do_write_bandwidth };
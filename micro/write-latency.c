@@ -0,0 +1,69 @@
+#define _GNU_SOURCE // For O_DIRECT
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <err.h>
+#include "../benchmarks.h"
+
+#ifndef O_DIRECT
+#define O_DIRECT	00040000	/* direct disk access hint */
+#endif
+
+static void do_write_latency(int fd, u32 runs,
+			     struct benchmark *bench, const void *opts)
+{
+	int testfd, flags = O_WRONLY|O_DIRECT;
+	bool sync = strends(bench->name, "-fdatasync");
+	struct stat st;
+	char *p, *pa;
+	unsigned long num;
+
+	if (strends(bench->name, "-dsync"))
+		flags |= O_DSYNC;
+
+	testfd = open(blockdev, flags, 0);
+	if (testfd < 0)
+		err(1, "opening %s", blockdev);
+
+	fstat(testfd, &st);
+	p = malloc(st.st_blksize*2);
+	/* O_DIRECT wants an aligned pointer. */
+	pa = (void *)(((unsigned long)p+st.st_blksize-1) & ~(st.st_blksize-1));
+	memset(pa, 0x5A, st.st_blksize);
+
+	num = blockdev_size(testfd) / st.st_blksize;
+	if (!num)
+		errx(1, "%s is too small", blockdev);
+
+	send_ack(fd);
+	if (wait_for_start(fd)) {
+		u32 i;
+
+		/* Walk the device, so the host can't just merge writes. */
+		for (i = 0; i < runs; i++) {
+			lseek(testfd, (off_t)(i % num) * st.st_blksize,
+			      SEEK_SET);
+			if (write(testfd, pa, st.st_blksize) != st.st_blksize)
+				err(1, "writing to %s", blockdev);
+			if (sync && fdatasync(testfd) != 0)
+				err(1, "syncing %s", blockdev);
+		}
+		send_ack(fd);
+	}
+	close(testfd);
+	free(p);
+}
+
+struct benchmark write_latency_benchmark _benchmark_
+= { "write-latency", "Time for one disk write",
+    do_single_bench, do_write_latency };
+
+struct benchmark write_latency_dsync_benchmark _benchmark_
+= { "write-latency-dsync", "Time for one O_DSYNC disk write",
+    do_single_bench, do_write_latency };
+
+struct benchmark write_latency_fdatasync_benchmark _benchmark_
+= { "write-latency-fdatasync", "Time for one disk write and fdatasync",
+    do_single_bench, do_write_latency };
@@ -256,6 +256,49 @@ bool results_range_done(struct results *r, bool rough)
 	return true;
 }
 
+/* Client-timed samples can span several orders of magnitude (and be
+ * zero), which get_peaks() can't cope with: bucket by power of two. */
+static struct peak *get_log2_peaks(const struct results *r, unsigned int *num)
+{
+	struct peak buckets[65], *peaks;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(buckets); i++) {
+		buckets[i].start = (u64)-1;
+		buckets[i].end = 0;
+		buckets[i].num_results = 0;
+	}
+	for (i = 0; i < r->num_results; i++) {
+		u64 res = r->results[i];
+		struct peak *b = &buckets[res ? 64 - __builtin_clzll(res) : 0];
+
+		if (res < b->start)
+			b->start = res;
+		if (res + 1 > b->end)
+			b->end = res + 1;
+		b->num_results++;
+	}
+
+	peaks = talloc_array(r, struct peak, ARRAY_SIZE(buckets));
+	*num = 0;
+	for (i = 0; i < ARRAY_SIZE(buckets); i++)
+		if (buckets[i].num_results)
+			peaks[(*num)++] = buckets[i];
+	return peaks;
+}
+
+bool results_samples_done(struct results *r, bool rough)
+{
+	if (r->num_results < MINIMUM_RUNS * (rough ? 1 : 5))
+		return false;
+
+	/* We give raw results */
+	r->overhead = 0;
+	r->peaks = get_log2_peaks(r, &r->num_peaks);
+	r->final_runs = 1;
+	return true;
+}
+
 char *results_to_dist_summary(struct results *r)
 {
 	char *str = talloc_strdup(r, "");
@@ -278,8 +321,10 @@ char *results_to_dist_summary(struct results *r)
 
 static int cmp_u64(const void *p1, const void *p2)
 {
-	/* We assume that the difference fits in an int. */
-	return *(u64 *)p1 - *(u64 *)p2;
+	u64 a = *(u64 *)p1, b = *(u64 *)p2;
+
+	/* The difference doesn't fit in an int for multi-second results. */
+	return a < b ? -1 : a > b;
 }
 
 static u64 median(const u64 *vals, unsigned int num)
@@ -301,6 +346,31 @@ char *results_to_quick_summary(struct results *r)
 	return talloc_asprintf(r, "%llu (%llu - %llu)", med, min, max);
 }
 
+char *results_to_percentiles(struct results *r)
+{
+	static const struct {
+		const char *name;
+		unsigned int permille;
+	} pcts[] = { { "p50", 500 }, { "p90", 900 },
+		     { "p99", 990 }, { "p99.9", 999 } };
+	u64 *sorted = talloc_array(r, u64, r->num_results);
+	char *str = talloc_strdup(r, "");
+	unsigned int i;
+
+	memcpy(sorted, r->results, sizeof(sorted[0]) * r->num_results);
+	qsort(sorted, r->num_results, sizeof(sorted[0]), cmp_u64);
+	for (i = 0; i < ARRAY_SIZE(pcts); i++) {
+		unsigned int idx = (u64)r->num_results * pcts[i].permille / 1000;
+
+		str = talloc_asprintf_append(str, "%s%s %llu",
+					     i > 0 ? ", " : "", pcts[i].name,
+					     (sorted[idx] - r->overhead)
+					     / r->final_runs);
+	}
+	talloc_free(sorted);
+	return str;
+}
+
 char *results_to_csv(struct results *r)
 {
 	char *str = talloc_strdup(r, "");
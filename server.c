@@ -1,4 +1,5 @@
 /* The framework for coordinating and timing benchmarks. */
+#define _GNU_SOURCE // For splice and CPU_SET
 #include <stdio.h>
 #include <unistd.h>
 #include <sys/types.h>
@@ -8,6 +9,7 @@
 #include <assert.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/time.h>
 #include <time.h>
 #include <signal.h>
@@ -15,7 +17,10 @@
 #include <stdlib.h>
 #include <sys/ioctl.h>
 #include <getopt.h>
+#include <fnmatch.h>
 #include <net/if.h>
+#include <fcntl.h>
+#include <sched.h>
 #include "talloc.h"
 #include "stdrusty.h"
 #include "benchmarks.h"
@@ -36,6 +41,9 @@ static void __attribute__((noreturn)) usage(int exitstatus)
 static const char *virtdir;
 static int sockets[NUM_MACHINES] = { [0 ... NUM_MACHINES-1] = -1 };
 static bool progress = false, profile = false;
+/* How do_receive_bench drains the client: splice, and which CPU (-1: any). */
+static bool splice_receive = false;
+static int receive_cpu = -1;
 
 static void start_timeout_timer(unsigned int msecs)
 {
@@ -77,11 +85,50 @@ static void send_start_to_client(int dst)
 		err(1, "sending start to %i", dst);
 }
 
+/* Clients can attach a note to the results (eg. the guest clocksource).
+ * Each client's latest note wins, so both sides of a pair can have one. */
+static char *notes[NUM_MACHINES];
+
+static void recv_note(int dst, unsigned int len)
+{
+	unsigned int done = 0;
+	char *note;
+	int ret;
+
+	talloc_free(notes[dst]);
+	note = notes[dst] = talloc_array(NULL, char, len + 1);
+	while (done < len) {
+		ret = read(sockets[dst], note + done, len - done);
+		if (ret < 0 && errno == EINTR)
+			errno = ETIMEDOUT;
+		if (ret < 0)
+			err(1, "reading note from client %i", dst);
+		if (ret == 0)
+			errx(1, "client %i closed connection", dst);
+		done += ret;
+	}
+	note[len] = '\0';
+}
+
+/* A do_single_bench client which can't run in this guest says so. */
+#define SKIPPED_NOTE "skipped: "
+
+static bool client_skipped(int dst)
+{
+	return notes[dst] && strstarts(notes[dst], SKIPPED_NOTE);
+}
+
 static void recv_from_client(int dst)
 {
 	int ans;
+again:
 	switch (read(sockets[dst], &ans, sizeof(ans))) {
 	case sizeof(ans):
+		/* Non-zero means a note of that length precedes the reply. */
+		if (ans > 0) {
+			recv_note(dst, ans);
+			goto again;
+		}
 		return;
 	case -1:
 		if (errno == EINTR)
@@ -333,6 +380,10 @@ struct results *do_single_bench(struct benchmark *bench, bool rough,
 		start_timer(&start);
 		send_start_to_client(client[0]);
 		add_result(r, end_test(&start, client, 1));
+		if (client_skipped(client[0])) {
+			talloc_free(r);
+			return NULL;
+		}
 		if (progress) {
 			printf(".");
 			fflush(stdout);
@@ -354,6 +405,29 @@ static u32 getip(int client)
 	return ntohl(saddr.sin_addr.s_addr);
 }
 
+static void pick_pair(int clients[2])
+{
+	clients[0] = (random() % NUM_MACHINES);
+	do {
+		clients[1] = (random() % NUM_MACHINES);
+	} while (clients[1] == clients[0]);
+}
+
+/* clients[0] gets start = 1. */
+static void setup_pair(const int clients[2], const char *name, u32 runs)
+{
+	struct pair_opt opt;
+
+	opt.yourip = getip(clients[0]);
+	opt.otherip = getip(clients[1]);
+	opt.start = 1;
+	setup_bench(clients[0], name, &opt, sizeof(opt), runs);
+	opt.yourip = getip(clients[1]);
+	opt.otherip = getip(clients[0]);
+	opt.start = 0;
+	setup_bench(clients[1], name, &opt, sizeof(opt), runs);
+}
+
 static struct results *some_pair_bench(struct benchmark *bench,
 				       bool onestop, bool rough,
 				       unsigned int forced_runs)
@@ -362,14 +436,10 @@ static struct results *some_pair_bench(struct benchmark *bench,
 	struct results *r = new_results();
 	int clients[2];
 
-	clients[0] = (random() % NUM_MACHINES);
-	do {
-		clients[1] = (random() % NUM_MACHINES);
-	} while (clients[1] == clients[0]);
+	pick_pair(clients);
 
 	do {
 		struct timeval start;
-		struct pair_opt opt;
 
 		if (runs != prev_runs) {
 			if (progress) {
@@ -381,14 +451,7 @@ static struct results *some_pair_bench(struct benchmark *bench,
 			prev_runs = runs;
 		}
 
-		opt.yourip = getip(clients[0]);
-		opt.otherip = getip(clients[1]);
-		opt.start = 1;
-		setup_bench(clients[0], bench->name, &opt, sizeof(opt), runs);
-		opt.yourip = getip(clients[1]);
-		opt.otherip = getip(clients[0]);
-		opt.start = 0;
-		setup_bench(clients[1], bench->name, &opt, sizeof(opt), runs);
+		setup_pair(clients, bench->name, runs);
 
 		start_timer(&start);
 		send_start_to_client(clients[0]);
@@ -428,17 +491,103 @@ static void receive_data(int fd, void *mem, unsigned long size)
 		err(1, "reading @%lu %lu from other end %li", done, size, ret);
 }
 
-struct results *do_receive_bench(struct benchmark *bench, bool rough,
-				 unsigned int forced_runs)
+static void send_data(int fd, const void *mem, unsigned long size)
+{
+	if (!write_all(fd, mem, size))
+		err(1, "writing %lu to other end", size);
+}
+
+struct receiver
+{
+	int sock;
+	char *mem;
+	u32 runs;
+	/* For splice_receive. */
+	int pipe[2], nullfd;
+};
+
+/* Move it all to /dev/null without copying it into our memory. */
+static void splice_data(struct receiver *rcv, unsigned long size)
+{
+	while (size) {
+		long ret, moved;
+
+		ret = splice(rcv->sock, NULL, rcv->pipe[1], NULL, size,
+			     SPLICE_F_MOVE|SPLICE_F_MORE);
+		if (ret <= 0)
+			err(1, "splicing %lu from other end", size);
+		size -= ret;
+		for (; ret; ret -= moved) {
+			moved = splice(rcv->pipe[0], NULL, rcv->nullfd, NULL,
+				       ret, SPLICE_F_MOVE);
+			if (moved <= 0)
+				err(1, "splicing to /dev/null");
+		}
+	}
+}
+
+static void receive_runs(struct receiver *rcv, unsigned long size)
+{
+	if (splice_receive) {
+		int set = 1;
+
+		splice_data(rcv, size);
+		/* Unlike read(), splice doesn't ACK promptly, so the client's
+		 * final ack sits behind Nagle for a delayed-ACK timeout. */
+		setsockopt(rcv->sock, IPPROTO_TCP, TCP_QUICKACK,
+			   &set, sizeof(set));
+	} else
+		receive_data(rcv->sock, rcv->mem, size);
+}
+
+static void receive_all(struct receiver *rcv)
+{
+	unsigned int i;
+
+	/* Read warmup */
+	receive_runs(rcv, NET_WARMUP_BYTES);
+
+	/* Read real results. */
+	for (i = 0; i < rcv->runs; i++)
+		receive_runs(rcv, NET_BANDWIDTH_SIZE);
+}
+
+/* Stream NET_BANDWIDTH_SIZE per run over the client's own socket. */
+static struct results *some_stream_bench(struct benchmark *bench,
+					 bool sending, bool receiving,
+					 bool rough, unsigned int forced_runs)
 {
 	unsigned int runs = forced_runs, prev_runs = -1U;
 	struct results *r = new_results();
 	int client[1] = { random() % NUM_MACHINES };
 	char *recvmem = talloc_array(r, char, NET_BANDWIDTH_SIZE);
+	char *sendmem = talloc_zero_array(r, char, NET_BANDWIDTH_SIZE);
+	struct receiver rcv;
+	cpu_set_t oldset;
+
+	/* So our receiving doesn't compete with the machines for a CPU.
+	 * Pinning ourselves once keeps it out of the timed part. */
+	if (receive_cpu >= 0 && receiving && !sending) {
+		cpu_set_t set;
+
+		sched_getaffinity(0, sizeof(oldset), &oldset);
+		CPU_ZERO(&set);
+		CPU_SET(receive_cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set) != 0)
+			warn("could not pin to cpu %i", receive_cpu);
+	}
+	if (splice_receive) {
+		rcv.nullfd = open("/dev/null", O_WRONLY);
+		if (rcv.nullfd < 0 || pipe(rcv.pipe) != 0)
+			err(1, "opening /dev/null and pipe for splice");
+		/* Fewer, bigger splices: 1MB is the default unprivileged max. */
+		fcntl(rcv.pipe[1], F_SETPIPE_SZ, 1024 * 1024);
+	}
 
 	do {
 		struct timeval start;
 		unsigned int i;
+		int sock = sockets[client[0]];
 
 		if (runs != prev_runs) {
 			if (progress) {
@@ -453,13 +602,23 @@ struct results *do_receive_bench(struct benchmark *bench, bool rough,
 		start_timer(&start);
 		send_start_to_client(client[0]);
 
-		/* Read warmup */
-		receive_data(sockets[client[0]], recvmem, NET_WARMUP_BYTES);
-
-		/* Read real results. */
-		for (i = 0; i < runs; i++)
-			receive_data(sockets[client[0]], recvmem,
-				     NET_BANDWIDTH_SIZE);
+		if (sending && receiving) {
+			/* Warmup is just more of the same. */
+			if (!duplex_all(sock, sendmem, recvmem,
+					NET_WARMUP_BYTES
+					+ (u64)runs * NET_BANDWIDTH_SIZE,
+					NET_BANDWIDTH_SIZE))
+				err(1, "sending and receiving");
+		} else if (sending) {
+			send_data(sock, sendmem, NET_WARMUP_BYTES);
+			for (i = 0; i < runs; i++)
+				send_data(sock, sendmem, NET_BANDWIDTH_SIZE);
+		} else {
+			rcv.sock = sock;
+			rcv.mem = recvmem;
+			rcv.runs = runs;
+			receive_all(&rcv);
+		}
 
 		add_result(r, end_test(&start, client, 1));
 		if (progress) {
@@ -467,11 +626,120 @@ struct results *do_receive_bench(struct benchmark *bench, bool rough,
 			fflush(stdout);
 		}
 	} while (!results_done(r, &runs, rough, forced_runs));
+	if (profile)
+		dump_profile();
+	if (receive_cpu >= 0 && receiving && !sending)
+		sched_setaffinity(0, sizeof(oldset), &oldset);
+	if (splice_receive) {
+		close(rcv.nullfd);
+		close(rcv.pipe[0]);
+		close(rcv.pipe[1]);
+	}
+	return r;
+}
+
+struct results *do_receive_bench(struct benchmark *bench, bool rough,
+				 unsigned int forced_runs)
+{
+	return some_stream_bench(bench, false, true, rough, forced_runs);
+}
+
+struct results *do_send_bench(struct benchmark *bench, bool rough,
+			      unsigned int forced_runs)
+{
+	return some_stream_bench(bench, true, false, rough, forced_runs);
+}
+
+struct results *do_duplex_bench(struct benchmark *bench, bool rough,
+				unsigned int forced_runs)
+{
+	return some_stream_bench(bench, true, true, rough, forced_runs);
+}
+
+/* Number of samples we ask for from each do_sample_bench run. */
+#define SAMPLE_RUNS 1000
+
+static void receive_sample_data(int dst, void *buf, unsigned long size)
+{
+	unsigned long done = 0;
+	long ret;
+
+	while (done < size) {
+		ret = read(sockets[dst], (char *)buf + done, size - done);
+		if (ret < 0 && errno == EINTR)
+			errno = ETIMEDOUT;
+		if (ret < 0)
+			err(1, "reading samples from client %i", dst);
+		if (ret == 0)
+			errx(1, "client %i closed connection", dst);
+		done += ret;
+	}
+}
+
+/* Usually runs of them, but the client may send more (or fewer). */
+static u64 *receive_samples(const void *ctx, int dst, unsigned int *num)
+{
+	u64 *samples;
+
+	receive_sample_data(dst, num, sizeof(*num));
+	samples = talloc_array(ctx, u64, *num);
+	receive_sample_data(dst, samples, *num * sizeof(samples[0]));
+	return samples;
+}
+
+/* The client times each iteration itself, and sends us the samples.  For
+ * a pair, the samples come from the start = 1 client. */
+static struct results *some_sample_bench(struct benchmark *bench, bool pair,
+					 bool rough, unsigned int forced_runs)
+{
+	unsigned int i, num, runs = forced_runs ? forced_runs : SAMPLE_RUNS;
+	struct results *r = new_results();
+	int clients[2] = { random() % NUM_MACHINES };
+
+	if (pair)
+		pick_pair(clients);
+	if (profile)
+		reset_profile();
+	do {
+		struct timeval start;
+		u64 *samples;
+
+		if (pair)
+			setup_pair(clients, bench->name, runs);
+		else
+			setup_bench(clients[0], bench->name, "", 0, runs);
+		start_timer(&start);
+		send_start_to_client(clients[0]);
+		if (pair)
+			send_start_to_client(clients[1]);
+		samples = receive_samples(r, clients[0], &num);
+		end_test(&start, clients, pair ? 2 : 1);
+
+		for (i = 0; i < num; i++)
+			add_result(r, samples[i]);
+		talloc_free(samples);
+		if (progress) {
+			printf(".");
+			fflush(stdout);
+		}
+	} while (!results_samples_done(r, rough));
 	if (profile)
 		dump_profile();
 	return r;
 }
 
+struct results *do_sample_bench(struct benchmark *bench, bool rough,
+				unsigned int forced_runs)
+{
+	return some_sample_bench(bench, false, rough, forced_runs);
+}
+
+struct results *do_pair_sample_bench(struct benchmark *bench, bool rough,
+				     unsigned int forced_runs)
+{
+	return some_sample_bench(bench, true, rough, forced_runs);
+}
+
 struct results *do_clock_accuracy_bench(struct benchmark *bench, bool rough,
 					unsigned int forced_runs)
 {
@@ -519,8 +787,9 @@ static bool benchmark_listed(const char *bench, char *argv[])
 	if (!argv[0])
 		return true;
 
+	/* Globs let you run a whole size sweep, eg. 'pingpong-*'. */
 	for (i = 0; argv[i]; i++)
-		if (streq(bench, argv[i]))
+		if (fnmatch(argv[i], bench, 0) == 0)
 			return true;
 	return false;
 }
@@ -531,7 +800,7 @@ int main(int argc, char *argv[])
 	char **names;
 	struct sigaction act;
 	int sock;
-	unsigned int forced_runs = 0;
+	unsigned int i, forced_runs = 0;
 	bool done = false, rough = false;
 	const char *ifname = "eth0";
 	struct option lopts[] = {
@@ -541,8 +810,11 @@ int main(int argc, char *argv[])
 		{ "help", 0, 0, 'h' },
 		{ "ifname", 1, 0, 'i' },
 		{ "distribution", 0, 0, 'd' },
+		{ "percentiles", 0, 0, 'l' },
 		{ "rough", 0, 0, 'r' },
 		{ "runs", 1, 0, 'R' },
+		{ "splice-receive", 0, 0, 'S' },
+		{ "receive-cpu", 1, 0, 'C' },
 		{ 0 },
 	};
 	const char *sopts = "phc:";
@@ -570,12 +842,21 @@ int main(int argc, char *argv[])
 		case 'd':
 			printer = results_to_dist_summary;
 			break;
+		case 'l':
+			printer = results_to_percentiles;
+			break;
 		case 'r':
 			rough = true;
 			break;
 		case 'R':
 			forced_runs = atoi(optarg);
 			break;
+		case 'S':
+			splice_receive = true;
+			break;
+		case 'C':
+			receive_cpu = atoi(optarg);
+			break;
 		default:
 			usage(1);
 			break;
@@ -627,15 +908,33 @@ int main(int argc, char *argv[])
 		results = b->server(b, rough, forced_runs);
 		if (progress)
 			printf("\n");
+		if (!results) {
+			for (i = 0; i < NUM_MACHINES; i++) {
+				if (client_skipped(i))
+					printf("DISABLED %s: %s\n", b->name,
+					       notes[i] + strlen(SKIPPED_NOTE));
+				talloc_free(notes[i]);
+				notes[i] = NULL;
+			}
+			continue;
+		}
 
 		if (csv_fp)
 			fprintf(csv_fp, "%s\n", results_to_csv(results));
 
 		if (forced_runs)
-			printf("%s (x %u): %s\n",
+			printf("%s (x %u): %s",
 			       b->pretty_name, forced_runs, printer(results));
 		else
-			printf("%s: %s\n", b->pretty_name, printer(results));
+			printf("%s: %s", b->pretty_name, printer(results));
+		for (i = 0; i < NUM_MACHINES; i++) {
+			if (notes[i]) {
+				printf(" [%s]", notes[i]);
+				talloc_free(notes[i]);
+				notes[i] = NULL;
+			}
+		}
+		printf("\n");
 	}
 
 	if (!done)
@@ -656,5 +955,21 @@ void send_ack(int sock)
 {
 	assert(0);
 }
+void send_samples(int sock, const u64 *samples, u32 num)
+{
+	assert(0);
+}
+void send_note(int sock, const char *note)
+{
+	assert(0);
+}
+u64 blockdev_size(int fd)
+{
+	assert(0);
+}
+unsigned long bench_size(const struct benchmark *bench, unsigned long def)
+{
+	assert(0);
+}
 char *argv0;
 char *blockdev;
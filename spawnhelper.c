@@ -0,0 +1,5 @@
+/* Built static, so posix-spawn measures spawning, not dynamic linking. */
+int main(void)
+{
+	return 0;
+}
@@ -8,6 +8,8 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <poll.h>
 #include <signal.h>
 #include <assert.h>
 #include <err.h>
@@ -177,6 +179,48 @@ bool read_all(int fd, void *data, unsigned long size)
 	return true;
 }
 
+bool duplex_all(int fd, const void *sendbuf, void *recvbuf,
+		u64 size, unsigned long bufsize)
+{
+	u64 sent = 0, received = 0;
+
+	while (sent < size || received < size) {
+		struct pollfd pfd = { .fd = fd };
+		long ret;
+
+		if (sent < size)
+			pfd.events |= POLLOUT;
+		if (received < size)
+			pfd.events |= POLLIN;
+		if (poll(&pfd, 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		if (pfd.revents & POLLOUT) {
+			ret = send(fd, sendbuf, min(size - sent, (u64)bufsize),
+				   MSG_DONTWAIT);
+			if (ret < 0 && errno != EAGAIN && errno != EINTR)
+				return false;
+			if (ret > 0)
+				sent += ret;
+		}
+		if (pfd.revents & (POLLIN|POLLHUP|POLLERR)) {
+			ret = recv(fd, recvbuf, min(size - received, (u64)bufsize),
+				   MSG_DONTWAIT);
+			if (ret == 0)
+				errno = ECONNRESET;
+			if (ret == 0
+			    || (ret < 0 && errno != EAGAIN && errno != EINTR))
+				return false;
+			if (ret > 0)
+				received += ret;
+		}
+	}
+	return true;
+}
+
 void _delete_arr(void *p, unsigned len, unsigned off, unsigned num, size_t s)
 {
 	assert(off + num <= len);
@@ -80,6 +80,9 @@ void _delete_arr(void *p, unsigned len, unsigned off, unsigned num, size_t s);
 /* Write/read this much data. */
 bool write_all(int fd, const void *data, unsigned long size);
 bool read_all(int fd, void *data, unsigned long size);
+/* Send and receive size bytes on a socket at once, bufsize at a time. */
+bool duplex_all(int fd, const void *sendbuf, void *recvbuf,
+		u64 size, unsigned long bufsize);
 
 bool is_dir(const char *dirname);
 